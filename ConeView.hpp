@@ -31,17 +31,17 @@ public:
         return new ConeView(*this);
     }
 
-    bool intersects(const AlignedBox3& box) override
+    bool intersects(const AlignedBox3& box) const override
     {
-        return query(box,cone).intersect;
+        return getQuery()(box,cone).intersect;
     }
 
-    bool contains(const Vector3& vector) override
+    bool contains(const Vector3& vector) const override
     {
         return gte::InContainer(vector,cone);
     }
 
-    bool contains(const AlignedBox3& box) override
+    bool contains(const AlignedBox3& box) const override
     {
         if (!gte::InContainer(box.min, cone))
             return false;
@@ -61,6 +61,16 @@ public:
         return true;
     }
 
+    Containment classify(const AlignedBox3& box) const override
+    {
+        return libzealand::classify(box,cone,getQuery());
+    }
+
+    void classify8(const Box8& boxes, std::uint8_t active, std::uint8_t& inside, std::uint8_t& partial) const override
+    {
+        libzealand::classify8(boxes,cone,getQuery(),active,inside,partial);
+    }
+
     void updatePose(Real x, Real y, Real z,
                     Real r1c1, Real r1c2, Real r1c3, 
                     Real r2c1, Real r2c2, Real r2c3, 
@@ -84,7 +94,13 @@ protected:
     // In sensor frame
     Vector3 direction;
 
-    gte::TIQuery<Real,AlignedBox3,Cone3> query;
+    // The box-cone query keeps scratch state between calls,
+    // so every thread has its own
+    static gte::TIQuery<Real,AlignedBox3,Cone3>& getQuery()
+    {
+        thread_local gte::TIQuery<Real,AlignedBox3,Cone3> query;
+        return query;
+    }
 };
 }
 
@@ -1,6 +1,8 @@
 #ifndef GTEFOV_hpp
 #define GTEFOV_hpp
 
+#include <type_traits>
+
 namespace libzealand
 {
 template <class GTEPrimative>
@@ -18,18 +20,18 @@ class GTEFOV : public VolumeFOV
             return new GTEFOV(*this);
         }
 
-        bool intersects (const AlignedBox3& box) override
+        bool intersects (const AlignedBox3& box) const override
         {
-            return query(box, shape).intersect;
+            return getQuery()(box, shape).intersect;
         }
 
-        bool contains(const Vector3& vector) override
+        bool contains(const Vector3& vector) const override
         {
             return gte::InContainer(vector,shape);
         }
 
 
-        bool contains (const AlignedBox3& box) override
+        bool contains (const AlignedBox3& box) const override
         {
             std::array<Vector3,8> vertices;
             box.GetVertices(vertices);
@@ -45,10 +47,45 @@ class GTEFOV : public VolumeFOV
             return true;
         }
 
+        Containment classify (const AlignedBox3& box) const override
+        {
+            if constexpr (std::is_same_v<GTEPrimative,Sphere3>)
+                return libzealand::classify(box, shape);
+            else if constexpr (std::is_same_v<GTEPrimative,Cone3>)
+                return libzealand::classify(box, shape, getQuery());
+            else
+                return classifyByVertices(box, shape, getQuery());
+        }
+
+        AlignedBox3 getBoundingBox () const override
+        {
+            if constexpr (std::is_same_v<GTEPrimative,Sphere3>)
+                return libzealand::getBoundingBox(shape);
+            else
+                return VolumeFOV::getBoundingBox();
+        }
+
+        void classify8 (const Box8& boxes, std::uint8_t active, std::uint8_t& inside, std::uint8_t& partial) const override
+        {
+            if constexpr (std::is_same_v<GTEPrimative,Sphere3>)
+                libzealand::classify8(boxes, shape, inside, partial);
+            else if constexpr (std::is_same_v<GTEPrimative,Cone3>)
+                libzealand::classify8(boxes, shape, getQuery(), active, inside, partial);
+            else
+                VolumeFOV::classify8(boxes, active, inside, partial);
+        }
+
     protected:
 
         GTEPrimative shape;
-        gte::TIQuery<Real,AlignedBox3,GTEPrimative> query;
+
+        // GTE queries may keep scratch state between calls,
+        // so every thread has its own
+        static gte::TIQuery<Real,AlignedBox3,GTEPrimative>& getQuery()
+        {
+            thread_local gte::TIQuery<Real,AlignedBox3,GTEPrimative> query;
+            return query;
+        }
 };
 }
 
@@ -0,0 +1,148 @@
+#ifndef Generator_hpp
+#define Generator_hpp
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <ranges>
+#include <utility>
+
+namespace libzealand
+{
+// Lazy sequence of values produced by a coroutine with co_yield,
+// until std::generator is available. The coroutine runs only as
+// far as the next value each time the iterator is advanced, so
+// nothing but the coroutine frame is held in memory.
+// A Generator is a move-only input view and can start a ranges pipeline.
+template <class T>
+class Generator : public std::ranges::view_interface<Generator<T>>
+{
+    public:
+
+        struct promise_type
+        {
+            const T* value = nullptr;
+            std::exception_ptr exception;
+
+            Generator get_return_object()
+            {
+                return Generator(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+
+            // The value lives in the suspended coroutine until it is resumed
+            std::suspend_always yield_value(const T& yielded) noexcept
+            {
+                value = std::addressof(yielded);
+                return {};
+            }
+
+            void return_void() {}
+
+            void unhandled_exception()
+            {
+                exception = std::current_exception();
+            }
+
+            // co_await is not supported in a generator
+            template <class U>
+            std::suspend_never await_transform(U&&) = delete;
+        };
+
+        class iterator
+        {
+            public:
+
+                using value_type = T;
+                using difference_type = std::ptrdiff_t;
+
+                iterator() = default;
+
+                explicit iterator(std::coroutine_handle<promise_type> coroutine) : coroutine(coroutine)
+                {
+                }
+
+                const T& operator*() const
+                {
+                    return *coroutine.promise().value;
+                }
+
+                iterator& operator++()
+                {
+                    resume(coroutine);
+                    return *this;
+                }
+
+                void operator++(int)
+                {
+                    ++*this;
+                }
+
+                bool operator==(std::default_sentinel_t) const
+                {
+                    return !coroutine || coroutine.done();
+                }
+
+            private:
+
+                std::coroutine_handle<promise_type> coroutine;
+        };
+
+        Generator() = default;
+
+        Generator(Generator&& other) noexcept : coroutine(std::exchange(other.coroutine, nullptr))
+        {
+        }
+
+        Generator& operator=(Generator&& other) noexcept
+        {
+            if (this != &other)
+            {
+                if (coroutine)
+                    coroutine.destroy();
+                coroutine = std::exchange(other.coroutine, nullptr);
+            }
+            return *this;
+        }
+
+        ~Generator()
+        {
+            if (coroutine)
+                coroutine.destroy();
+        }
+
+        // Runs the coroutine to its first value, so begin() is called once
+        iterator begin()
+        {
+            if (coroutine)
+                resume(coroutine);
+            return iterator(coroutine);
+        }
+
+        std::default_sentinel_t end() const
+        {
+            return std::default_sentinel;
+        }
+
+    private:
+
+        explicit Generator(std::coroutine_handle<promise_type> coroutine) : coroutine(coroutine)
+        {
+        }
+
+        // Run to the next co_yield, rethrowing anything the coroutine threw
+        static void resume(std::coroutine_handle<promise_type> coroutine)
+        {
+            coroutine.resume();
+            if (coroutine.promise().exception)
+                std::rethrow_exception(coroutine.promise().exception);
+        }
+
+        std::coroutine_handle<promise_type> coroutine;
+};
+}
+
+#endif
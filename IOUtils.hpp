@@ -9,6 +9,7 @@
 #include <fstream>
 #include <stdexcept>
 #include <algorithm>
+#include <span>
 
 #include <fmt/format.h>
 
@@ -159,31 +160,29 @@ namespace IOUtils
         ofs.close();
     }
 
-    // filename is the base filename
-    // inline void print_multiplicities(const std::vector<std::vector<unsigned int>>& multiplicities, std::string filename)
-    // {
-    //     std::string ext = ".csv";
-    //     for (int i = 0; i < multiplicities.size(); i++)
-    //     {
-    //         if (!multiplicities[i].empty())
-    //         {
-    //             std::string filename_num = filename + std::to_string(i) + ext;
-    //             print_multiplicity(multiplicities[i], filename);
-    //         }
-    //     }
-    // }
-
-    // inline void print_multiplicity(const std::vector<unsigned int>& multiplicity, std::string filename)
-    // {
-    //     std::ofstream ofs(filename);
-    //     for (int i = 0; i < multiplicity.size() - 1; i+=2)
-    //     {
-    //         unsigned int start = multiplicity[i];
-    //         unsigned int stop = multiplicity[i+1];
-
-    //         ofs << fmt::format("{},{}")
-    //     }
-    // }
+    // One line of start,stop per interval of a multiplicity
+    inline void print_multiplicity(std::span<const unsigned long> multiplicity, std::ofstream& ofs)
+    {
+        for (std::size_t i = 0; i + 1 < multiplicity.size(); i += 2)
+            ofs << fmt::format("{},{}\n", multiplicity[i], multiplicity[i+1]);
+    }
+
+    inline void print_multiplicity(std::span<const unsigned long> multiplicity, std::string filename)
+    {
+        std::ofstream ofs(filename);
+        print_multiplicity(multiplicity, ofs);
+    }
+
+    // filename is the base filename, and multiplicity m goes to filename + m + ".csv"
+    inline void print_multiplicities(const Multiplicities& multiplicities, std::string filename)
+    {
+        std::string ext = ".csv";
+        for (std::size_t i = 0; i < multiplicities.size(); i++)
+        {
+            if (!multiplicities[i].empty())
+                print_multiplicity(multiplicities[i], filename + std::to_string(i + 1) + ext);
+        }
+    }
 }
 
 #endif
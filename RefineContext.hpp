@@ -0,0 +1,69 @@
+#ifndef RefineContext_hpp
+#define RefineContext_hpp
+
+#include <utility>
+#include <vector>
+
+#include "util.hpp"
+
+namespace libzealand
+{
+// Reusable buffers for breadth-first refines.
+// The partial frontier and its masks ping-pong between coverage[0]
+// and next, and the full blocks accumulate in coverage[1]. Clearing
+// a vector keeps its capacity, so once a context has held a refine
+// as large as the current one, refining with it allocates nothing.
+// Keep a context per thread across time steps.
+class RefineContext
+{
+    public:
+
+        RefineContext() = default;
+
+        // Preallocate for refines of up to num_partial partial and num_full full blocks
+        RefineContext(std::size_t num_partial, std::size_t num_full)
+        {
+            reserve(num_partial, num_full);
+        }
+
+        void reserve(std::size_t num_partial, std::size_t num_full)
+        {
+            coverage[0].reserve(num_partial);
+            masks.reserve(num_partial);
+            next.reserve(num_partial);
+            next_masks.reserve(num_partial);
+            coverage[1].reserve(num_full);
+        }
+
+        // Start from a single partial block, by default the super-block,
+        // undecided against the shapes in mask
+        void reset(ShapeMask mask, unsigned long block = 1ul)
+        {
+            coverage[0].clear();
+            coverage[1].clear();
+            masks.clear();
+
+            coverage[0].push_back(block);
+            masks.push_back(mask);
+        }
+
+        // Make the next frontier current and clear the old one for reuse
+        void advance()
+        {
+            std::swap(coverage[0], next);
+            std::swap(masks, next_masks);
+            next.clear();
+            next_masks.clear();
+        }
+
+        // Current frontier and full blocks
+        Coverage coverage;
+        std::vector<ShapeMask> masks;
+
+        // Frontier being built
+        Blockset next;
+        std::vector<ShapeMask> next_masks;
+};
+}
+
+#endif
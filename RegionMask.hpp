@@ -0,0 +1,96 @@
+#ifndef RegionMask_hpp
+#define RegionMask_hpp
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "util.hpp"
+
+namespace libzealand
+{
+// Region of interest that a refine is restricted to.
+// Blocks outside the region are dropped, and blocks inside it
+// are not tested against it again, so the region is evaluated
+// once per subtree rather than once per box.
+class RegionMask
+{
+    public:
+
+        // Region made of the blocks of a blockset, of any levels and in any order
+        RegionMask(const Blockset& blocks)
+        {
+            for (unsigned long block : blocks)
+            {
+                unsigned long first = curvePosition(block);
+                intervals.push_back({first, first | set3NBits(MAX_LEVEL - getLevel(block))});
+            }
+            mergeIntervals();
+        }
+
+        // Region made of intervals [start, stop] of blocks on one level, as from toIntervals
+        RegionMask(const Intervalset& intervals) : RegionMask(toBlocks(intervals))
+        {
+        }
+
+        // Region given by the containment of a box in it
+        RegionMask(std::function<Containment(const AlignedBox3&)> predicate) : predicate(std::move(predicate))
+        {
+        }
+
+        // -1 if block, whose box is box, is outside the region,
+        // 1 if it is inside and 0 if it crosses the boundary
+        int classify(unsigned long block, const AlignedBox3& box) const
+        {
+            if (predicate)
+                return static_cast<int>(predicate(box)) - 1;
+
+            unsigned long first = curvePosition(block);
+            unsigned long last = first | set3NBits(MAX_LEVEL - getLevel(block));
+
+            // First interval ending at or after the block
+            auto it = std::lower_bound(intervals.begin(), intervals.end(), first,
+                [](const Interval& interval, unsigned long position){ return interval[1] < position; });
+
+            if (it == intervals.end() || (*it)[0] > last)
+                return -1;
+            if ((*it)[0] <= first && (*it)[1] >= last)
+                return 1;
+            return 0;
+        }
+
+    private:
+
+        static Blockset toBlocks(const Intervalset& intervals)
+        {
+            Blockset blocks;
+            for (const Interval& interval : intervals)
+                interval_to_cells(interval[0], interval[1], blocks);
+            return blocks;
+        }
+
+        // Sort the intervals and join those that overlap or touch,
+        // so that a block inside the region lies in a single interval
+        void mergeIntervals()
+        {
+            std::sort(intervals.begin(), intervals.end());
+
+            std::size_t n = 0;
+            for (std::size_t i = 0; i < intervals.size(); i++)
+            {
+                if (n > 0 && (intervals[n-1][1] == ~0ul || intervals[i][0] <= intervals[n-1][1] + 1))
+                    intervals[n-1][1] = std::max(intervals[n-1][1], intervals[i][1]);
+                else
+                    intervals[n++] = intervals[i];
+            }
+            intervals.resize(n);
+        }
+
+        // Level-20 curve positions covered by the region, sorted and disjoint
+        Intervalset intervals;
+        std::function<Containment(const AlignedBox3&)> predicate;
+};
+}
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef ShapePack_hpp
+#define ShapePack_hpp
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "util.hpp"
+#include "VolumeFOV.hpp"
+
+namespace libzealand
+{
+// Shapes known at compile time, refined without virtual calls.
+// Exclude is false for included shapes and true for not_shapes.
+// The pack only references the shapes, so they must outlive it.
+template <bool Exclude, class... Shapes>
+struct ShapePack
+{
+    static constexpr std::size_t size = sizeof...(Shapes);
+
+    std::tuple<Shapes&...> shapes;
+};
+
+template <class... Shapes>
+inline ShapePack<false, Shapes...> include(Shapes&... shapes)
+{
+    return {std::tuple<Shapes&...>(shapes...)};
+}
+
+template <class... Shapes>
+inline ShapePack<true, Shapes...> exclude(Shapes&... shapes)
+{
+    return {std::tuple<Shapes&...>(shapes...)};
+}
+
+// Classify a box against a shape whose type is known at compile time.
+// Views are called through their own classify(), bypassing the vtable,
+// and bare GTE primitives use the same kernels as GTEFOV.
+template <class Shape>
+inline Containment classifyShape(const AlignedBox3& box, Shape& shape)
+{
+    using Primitive = std::remove_const_t<Shape>;
+
+    if constexpr (std::is_base_of_v<VolumeFOV, Primitive>)
+        return shape.Primitive::classify(box);
+    else if constexpr (std::is_same_v<Primitive, Sphere3> || std::is_same_v<Primitive, Halfspace3>)
+        return classify(box, shape);
+    else if constexpr (std::is_same_v<Primitive, Cone3>)
+    {
+        gte::TIQuery<Real, AlignedBox3, Cone3> query;
+        return classify(box, shape, query);
+    }
+    else
+    {
+        gte::TIQuery<Real, AlignedBox3, Primitive> query;
+        return classifyByVertices(box, shape, query);
+    }
+}
+
+// classify8() of a shape whose type is known at compile time.
+// Views are called through their own classify8(), bypassing the vtable,
+// and bare GTE primitives use the same kernels as GTEFOV.
+template <class Shape>
+inline void classifyShape8(const Box8& boxes, Shape& shape, std::uint8_t active, std::uint8_t& inside, std::uint8_t& partial)
+{
+    using Primitive = std::remove_const_t<Shape>;
+
+    if constexpr (std::is_base_of_v<VolumeFOV, Primitive>)
+        shape.Primitive::classify8(boxes, active, inside, partial);
+    else if constexpr (std::is_same_v<Primitive, Sphere3> || std::is_same_v<Primitive, Halfspace3>)
+        classify8(boxes, shape, inside, partial);
+    else if constexpr (std::is_same_v<Primitive, Cone3>)
+    {
+        gte::TIQuery<Real, AlignedBox3, Cone3> query;
+        classify8(boxes, shape, query, active, inside, partial);
+    }
+    else
+    {
+        inside = 0;
+        partial = 0;
+        for (; active != 0; active &= active - 1)
+        {
+            int j = __builtin_ctz(active);
+            Containment c = classifyShape(boxes.getBox(j), shape);
+            inside |= (c == INSIDE) << j;
+            partial |= (c == PARTIAL) << j;
+        }
+    }
+}
+
+// Bounding box of a shape whose type is known at compile time,
+// the same as getBoundingBox() of the view holding it
+template <class Shape>
+inline AlignedBox3 getShapeBoundingBox(Shape& shape)
+{
+    using Primitive = std::remove_const_t<Shape>;
+
+    if constexpr (std::is_base_of_v<VolumeFOV, Primitive>)
+        return shape.Primitive::getBoundingBox();
+    else if constexpr (std::is_same_v<Primitive, Sphere3>)
+        return getBoundingBox(shape);
+    else
+    {
+        const Real inf = std::numeric_limits<Real>::infinity();
+        return AlignedBox3(Vector3({-inf, -inf, -inf}), Vector3({inf, inf, inf}));
+    }
+}
+
+// Test one shape of a pack if it is still undecided.
+// Returns false if the box is excluded by the shape.
+template <bool Exclude, class Shape>
+inline bool classifyPackShape(const AlignedBox3& box, Shape& shape, ShapeMask bit, ShapeMask mask, ShapeMask& undecided)
+{
+    if ((mask & bit) == 0)
+        return true;
+
+    Containment c = classifyShape(box, shape);
+    if (c == (Exclude ? INSIDE : OUTSIDE))
+        return false;
+    else if (c == PARTIAL)
+        undecided |= bit;
+    return true;
+}
+
+// Test the shapes of a pack in order, stopping at the first that excludes the box.
+// The bit of shape K in the mask is offset + K. An empty pack excludes nothing.
+template <bool Exclude, class... Shapes, std::size_t... K>
+inline bool classifyPack(const AlignedBox3& box, const ShapePack<Exclude, Shapes...>& pack, int offset,
+    [[maybe_unused]] ShapeMask mask, ShapeMask& undecided, std::index_sequence<K...>)
+{
+    return (classifyPackShape<Exclude>(box, std::get<K>(pack.shapes), ShapeMask(1) << (offset + K), mask, undecided) && ...);
+}
+
+// Test one shape of a pack against the boxes in alive if it is still undecided.
+// Boxes excluded by the shape are removed from alive, and the shape
+// is added to box_masks[j] for each box j left crossing its boundary.
+template <bool Exclude, class Shape>
+inline void classifyPackShape8(const Box8& boxes, Shape& shape, ShapeMask bit, ShapeMask mask,
+    std::uint8_t& alive, std::array<ShapeMask,8>& box_masks)
+{
+    if ((mask & bit) == 0 || alive == 0)
+        return;
+
+    std::uint8_t inside, partial;
+    classifyShape8(boxes, shape, alive, inside, partial);
+
+    std::uint8_t excluded = Exclude ? inside : ~(inside | partial);
+    alive &= ~excluded;
+    for (std::uint8_t undecided = alive & partial; undecided != 0; undecided &= undecided - 1)
+        box_masks[__builtin_ctz(undecided)] |= bit;
+}
+
+// Test the shapes of a pack in order against 8 boxes at once,
+// with the same mask bits as classifyPack
+template <bool Exclude, class... Shapes, std::size_t... K>
+inline void classifyPack8(const Box8& boxes, const ShapePack<Exclude, Shapes...>& pack, int offset,
+    [[maybe_unused]] ShapeMask mask, std::uint8_t& alive, std::array<ShapeMask,8>& box_masks, std::index_sequence<K...>)
+{
+    (classifyPackShape8<Exclude>(boxes, std::get<K>(pack.shapes), ShapeMask(1) << (offset + K), mask, alive, box_masks), ...);
+}
+}
+
+#endif
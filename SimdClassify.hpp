@@ -0,0 +1,368 @@
+#ifndef SimdClassify_hpp
+#define SimdClassify_hpp
+
+#include <cstdint>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "util.hpp"
+
+// Batch classification of the 8 children of a block.
+// With AVX-512 all 8 boxes are tested in one register, with AVX2
+// in two halves of 4, and otherwise one at a time. Every variant
+// performs the same operations in the same order as the scalar
+// classify() functions below, so they give the same answers.
+namespace libzealand
+{
+    // The 8 children of a block in structure-of-arrays form.
+    // Child j is min[axis][j] to max[axis][j] on each axis.
+    struct Box8
+    {
+        alignas(64) Real min[3][8];
+        alignas(64) Real max[3][8];
+
+        AlignedBox3 getBox(int j) const
+        {
+            return AlignedBox3(Vector3({min[0][j], min[1][j], min[2][j]}),
+                               Vector3({max[0][j], max[1][j], max[2][j]}));
+        }
+    };
+
+    // The kernels below ignore the height bounds of a cone,
+    // so they only apply to one running from its apex to infinity
+    inline bool isUnbounded(const Cone3& cone)
+    {
+        return cone.GetMinHeight() == 0 && cone.IsInfinite();
+    }
+
+    // Is a point inside an infinite cone narrower than a half space?
+    inline bool inCone(Real dx, Real dy, Real dz, const Cone3& cone)
+    {
+        const Vector3& dir = cone.ray.direction;
+        Real h = dir[0]*dx + dir[1]*dy + dir[2]*dz;
+        Real dist_sqr = dx*dx + dy*dy + dz*dz;
+        return h >= 0 && h*h >= cone.cosAngleSqr*dist_sqr;
+    }
+
+    // Classify a box against a cone narrower than a half space.
+    // Like classifyByVertices, the query only runs when no vertex is inside.
+    // Cones with height bounds are passed on to classifyByVertices.
+    template <class Query>
+    inline Containment classify(const AlignedBox3& box, const Cone3& cone, Query& query)
+    {
+        if (!isUnbounded(cone))
+            return classifyByVertices(box, cone, query);
+
+        const Vector3& origin = cone.ray.origin;
+
+        int num_inside = 0;
+        for (int v = 0; v < 8; v++)
+        {
+            Real dx = ((v & 1) ? box.max[0] : box.min[0]) - origin[0];
+            Real dy = ((v & 2) ? box.max[1] : box.min[1]) - origin[1];
+            Real dz = ((v & 4) ? box.max[2] : box.min[2]) - origin[2];
+
+            if (inCone(dx, dy, dz, cone))
+                num_inside++;
+        }
+
+        if (num_inside == 8)
+            return INSIDE;
+        else if (num_inside > 0 || query(box, cone).intersect)
+            return PARTIAL;
+        return OUTSIDE;
+    }
+
+    // Classify a box against the half space Dot(normal, x) >= constant
+    // using its nearest and farthest vertices along the normal
+    inline Containment classify(const AlignedBox3& box, const Halfspace3& halfspace)
+    {
+        Real lowest = 0;
+        Real highest = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            Real lo = halfspace.normal[i]*box.min[i];
+            Real hi = halfspace.normal[i]*box.max[i];
+            lowest += std::min(lo, hi);
+            highest += std::max(lo, hi);
+        }
+
+        if (highest < halfspace.constant)
+            return OUTSIDE;
+        else if (lowest >= halfspace.constant)
+            return INSIDE;
+        return PARTIAL;
+    }
+
+#if defined(__AVX512F__)
+
+    inline void classify8(const Box8& boxes, const Sphere3& sphere, std::uint8_t& inside, std::uint8_t& partial)
+    {
+        const __m512d zero = _mm512_setzero_pd();
+        __m512d near_sqr = zero;
+        __m512d far_sqr = zero;
+        for (int i = 0; i < 3; i++)
+        {
+            __m512d center = _mm512_set1_pd(sphere.center[i]);
+            __m512d lo = _mm512_sub_pd(_mm512_load_pd(boxes.min[i]), center);
+            __m512d hi = _mm512_sub_pd(_mm512_load_pd(boxes.max[i]), center);
+            __m512d lo_sqr = _mm512_mul_pd(lo, lo);
+            __m512d hi_sqr = _mm512_mul_pd(hi, hi);
+
+            __mmask8 lo_out = _mm512_cmp_pd_mask(lo, zero, _CMP_GT_OQ);
+            __mmask8 hi_out = _mm512_cmp_pd_mask(hi, zero, _CMP_LT_OQ);
+            __m512d near_axis = _mm512_mask_mov_pd(_mm512_maskz_mov_pd(hi_out, hi_sqr), lo_out, lo_sqr);
+
+            near_sqr = _mm512_add_pd(near_sqr, near_axis);
+            far_sqr = _mm512_add_pd(far_sqr, _mm512_max_pd(lo_sqr, hi_sqr));
+        }
+
+        __m512d radius_sqr = _mm512_set1_pd(sphere.radius*sphere.radius);
+        std::uint8_t outside = _mm512_cmp_pd_mask(near_sqr, radius_sqr, _CMP_GT_OQ);
+        inside = _mm512_cmp_pd_mask(far_sqr, radius_sqr, _CMP_LE_OQ) & ~outside;
+        partial = ~(outside | inside);
+    }
+
+    // Vertices inside the cone are counted for all 8 boxes at once
+    inline void coneVertices8(const Box8& boxes, const Cone3& cone, std::uint8_t& all, std::uint8_t& any)
+    {
+        const __m512d zero = _mm512_setzero_pd();
+        const __m512d cos_sqr = _mm512_set1_pd(cone.cosAngleSqr);
+        __m512d origin[3], dir[3], lo[3], hi[3];
+        for (int i = 0; i < 3; i++)
+        {
+            origin[i] = _mm512_set1_pd(cone.ray.origin[i]);
+            dir[i] = _mm512_set1_pd(cone.ray.direction[i]);
+            lo[i] = _mm512_sub_pd(_mm512_load_pd(boxes.min[i]), origin[i]);
+            hi[i] = _mm512_sub_pd(_mm512_load_pd(boxes.max[i]), origin[i]);
+        }
+
+        all = 0xFF;
+        any = 0;
+        for (int v = 0; v < 8; v++)
+        {
+            __m512d dx = (v & 1) ? hi[0] : lo[0];
+            __m512d dy = (v & 2) ? hi[1] : lo[1];
+            __m512d dz = (v & 4) ? hi[2] : lo[2];
+
+            __m512d h = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(dir[0], dx), _mm512_mul_pd(dir[1], dy)), _mm512_mul_pd(dir[2], dz));
+            __m512d dist_sqr = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(dy, dy)), _mm512_mul_pd(dz, dz));
+
+            __mmask8 in = _mm512_cmp_pd_mask(h, zero, _CMP_GE_OQ) &
+                _mm512_cmp_pd_mask(_mm512_mul_pd(h, h), _mm512_mul_pd(cos_sqr, dist_sqr), _CMP_GE_OQ);
+            all &= in;
+            any |= in;
+        }
+    }
+
+    inline void classify8(const Box8& boxes, const Halfspace3& halfspace, std::uint8_t& inside, std::uint8_t& partial)
+    {
+        __m512d lowest = _mm512_setzero_pd();
+        __m512d highest = _mm512_setzero_pd();
+        for (int i = 0; i < 3; i++)
+        {
+            __m512d normal = _mm512_set1_pd(halfspace.normal[i]);
+            __m512d lo = _mm512_mul_pd(normal, _mm512_load_pd(boxes.min[i]));
+            __m512d hi = _mm512_mul_pd(normal, _mm512_load_pd(boxes.max[i]));
+            lowest = _mm512_add_pd(lowest, _mm512_min_pd(lo, hi));
+            highest = _mm512_add_pd(highest, _mm512_max_pd(lo, hi));
+        }
+
+        __m512d constant = _mm512_set1_pd(halfspace.constant);
+        std::uint8_t outside = _mm512_cmp_pd_mask(highest, constant, _CMP_LT_OQ);
+        inside = _mm512_cmp_pd_mask(lowest, constant, _CMP_GE_OQ) & ~outside;
+        partial = ~(outside | inside);
+    }
+
+#elif defined(__AVX2__)
+
+    inline void classify8(const Box8& boxes, const Sphere3& sphere, std::uint8_t& inside, std::uint8_t& partial)
+    {
+        const __m256d zero = _mm256_setzero_pd();
+        const __m256d radius_sqr = _mm256_set1_pd(sphere.radius*sphere.radius);
+        int outside = 0;
+        int in = 0;
+        for (int half = 0; half < 8; half += 4)
+        {
+            __m256d near_sqr = zero;
+            __m256d far_sqr = zero;
+            for (int i = 0; i < 3; i++)
+            {
+                __m256d center = _mm256_set1_pd(sphere.center[i]);
+                __m256d lo = _mm256_sub_pd(_mm256_load_pd(boxes.min[i] + half), center);
+                __m256d hi = _mm256_sub_pd(_mm256_load_pd(boxes.max[i] + half), center);
+                __m256d lo_sqr = _mm256_mul_pd(lo, lo);
+                __m256d hi_sqr = _mm256_mul_pd(hi, hi);
+
+                // lo > 0 and hi < 0 cannot both hold, so the terms can be ORed
+                __m256d lo_out = _mm256_cmp_pd(lo, zero, _CMP_GT_OQ);
+                __m256d hi_out = _mm256_cmp_pd(hi, zero, _CMP_LT_OQ);
+                __m256d near_axis = _mm256_or_pd(_mm256_and_pd(lo_out, lo_sqr), _mm256_and_pd(hi_out, hi_sqr));
+
+                near_sqr = _mm256_add_pd(near_sqr, near_axis);
+                far_sqr = _mm256_add_pd(far_sqr, _mm256_max_pd(lo_sqr, hi_sqr));
+            }
+
+            outside |= _mm256_movemask_pd(_mm256_cmp_pd(near_sqr, radius_sqr, _CMP_GT_OQ)) << half;
+            in |= _mm256_movemask_pd(_mm256_cmp_pd(far_sqr, radius_sqr, _CMP_LE_OQ)) << half;
+        }
+
+        inside = in & ~outside;
+        partial = ~(outside | inside);
+    }
+
+    // Vertices inside the cone are counted for 4 boxes at a time
+    inline void coneVertices8(const Box8& boxes, const Cone3& cone, std::uint8_t& all, std::uint8_t& any)
+    {
+        const __m256d zero = _mm256_setzero_pd();
+        const __m256d cos_sqr = _mm256_set1_pd(cone.cosAngleSqr);
+
+        all = 0xFF;
+        any = 0;
+        for (int half = 0; half < 8; half += 4)
+        {
+            __m256d dir[3], lo[3], hi[3];
+            for (int i = 0; i < 3; i++)
+            {
+                __m256d origin = _mm256_set1_pd(cone.ray.origin[i]);
+                dir[i] = _mm256_set1_pd(cone.ray.direction[i]);
+                lo[i] = _mm256_sub_pd(_mm256_load_pd(boxes.min[i] + half), origin);
+                hi[i] = _mm256_sub_pd(_mm256_load_pd(boxes.max[i] + half), origin);
+            }
+
+            int half_all = 0xF;
+            int half_any = 0;
+            for (int v = 0; v < 8; v++)
+            {
+                __m256d dx = (v & 1) ? hi[0] : lo[0];
+                __m256d dy = (v & 2) ? hi[1] : lo[1];
+                __m256d dz = (v & 4) ? hi[2] : lo[2];
+
+                __m256d h = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dir[0], dx), _mm256_mul_pd(dir[1], dy)), _mm256_mul_pd(dir[2], dz));
+                __m256d dist_sqr = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)), _mm256_mul_pd(dz, dz));
+
+                __m256d in = _mm256_and_pd(_mm256_cmp_pd(h, zero, _CMP_GE_OQ),
+                    _mm256_cmp_pd(_mm256_mul_pd(h, h), _mm256_mul_pd(cos_sqr, dist_sqr), _CMP_GE_OQ));
+                int in_bits = _mm256_movemask_pd(in);
+                half_all &= in_bits;
+                half_any |= in_bits;
+            }
+
+            all &= ~(0xF << half) | (half_all << half);
+            any |= half_any << half;
+        }
+    }
+
+    inline void classify8(const Box8& boxes, const Halfspace3& halfspace, std::uint8_t& inside, std::uint8_t& partial)
+    {
+        const __m256d constant = _mm256_set1_pd(halfspace.constant);
+        int outside = 0;
+        int in = 0;
+        for (int half = 0; half < 8; half += 4)
+        {
+            __m256d lowest = _mm256_setzero_pd();
+            __m256d highest = _mm256_setzero_pd();
+            for (int i = 0; i < 3; i++)
+            {
+                __m256d normal = _mm256_set1_pd(halfspace.normal[i]);
+                __m256d lo = _mm256_mul_pd(normal, _mm256_load_pd(boxes.min[i] + half));
+                __m256d hi = _mm256_mul_pd(normal, _mm256_load_pd(boxes.max[i] + half));
+                lowest = _mm256_add_pd(lowest, _mm256_min_pd(lo, hi));
+                highest = _mm256_add_pd(highest, _mm256_max_pd(lo, hi));
+            }
+
+            outside |= _mm256_movemask_pd(_mm256_cmp_pd(highest, constant, _CMP_LT_OQ)) << half;
+            in |= _mm256_movemask_pd(_mm256_cmp_pd(lowest, constant, _CMP_GE_OQ)) << half;
+        }
+
+        inside = in & ~outside;
+        partial = ~(outside | inside);
+    }
+
+#else
+
+    inline void classify8(const Box8& boxes, const Sphere3& sphere, std::uint8_t& inside, std::uint8_t& partial)
+    {
+        inside = 0;
+        partial = 0;
+        for (int j = 0; j < 8; j++)
+        {
+            Containment c = classify(boxes.getBox(j), sphere);
+            inside |= (c == INSIDE) << j;
+            partial |= (c == PARTIAL) << j;
+        }
+    }
+
+    inline void coneVertices8(const Box8& boxes, const Cone3& cone, std::uint8_t& all, std::uint8_t& any)
+    {
+        const Vector3& origin = cone.ray.origin;
+
+        all = 0xFF;
+        any = 0;
+        for (int j = 0; j < 8; j++)
+        {
+            for (int v = 0; v < 8; v++)
+            {
+                Real dx = ((v & 1) ? boxes.max[0][j] : boxes.min[0][j]) - origin[0];
+                Real dy = ((v & 2) ? boxes.max[1][j] : boxes.min[1][j]) - origin[1];
+                Real dz = ((v & 4) ? boxes.max[2][j] : boxes.min[2][j]) - origin[2];
+
+                if (inCone(dx, dy, dz, cone))
+                    any |= 1 << j;
+                else
+                    all &= ~(1 << j);
+            }
+        }
+    }
+
+    inline void classify8(const Box8& boxes, const Halfspace3& halfspace, std::uint8_t& inside, std::uint8_t& partial)
+    {
+        inside = 0;
+        partial = 0;
+        for (int j = 0; j < 8; j++)
+        {
+            Containment c = classify(boxes.getBox(j), halfspace);
+            inside |= (c == INSIDE) << j;
+            partial |= (c == PARTIAL) << j;
+        }
+    }
+
+#endif
+
+    // Classify 8 boxes against a cone narrower than a half space.
+    // Active boxes with no vertex inside the cone fall back to the scalar query.
+    // Cones with height bounds classify each active box by its vertices.
+    template <class Query>
+    inline void classify8(const Box8& boxes, const Cone3& cone, Query& query, std::uint8_t active,
+        std::uint8_t& inside, std::uint8_t& partial)
+    {
+        if (!isUnbounded(cone))
+        {
+            inside = 0;
+            partial = 0;
+            for (; active != 0; active &= active - 1)
+            {
+                int j = __builtin_ctz(active);
+                Containment c = classifyByVertices(boxes.getBox(j), cone, query);
+                inside |= (c == INSIDE) << j;
+                partial |= (c == PARTIAL) << j;
+            }
+            return;
+        }
+
+        std::uint8_t any;
+        coneVertices8(boxes, cone, inside, any);
+        partial = any & ~inside;
+
+        for (std::uint8_t unresolved = active & ~any; unresolved != 0; unresolved &= unresolved - 1)
+        {
+            int j = __builtin_ctz(unresolved);
+            if (query(boxes.getBox(j), cone).intersect)
+                partial |= 1 << j;
+        }
+    }
+}
+
+#endif
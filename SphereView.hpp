@@ -20,8 +20,10 @@ public:
         return new SphereView(*this);
     }
 
-    bool intersects(const AlignedBox3& box) override
+    bool intersects(const AlignedBox3& box) const override
     {
+        // The sphere query has no state, so a local one is free
+        gte::TIQuery<Real,AlignedBox3,Sphere3> query;
         return query(box,sphere).intersect;
     }
 
@@ -41,12 +43,12 @@ public:
     //     return true;
     // }
 
-    bool contains(const Vector3& vector) override
+    bool contains(const Vector3& vector) const override
     {
         return gte::InContainer(vector,sphere);
     }
 
-    bool contains(const AlignedBox3& box) override
+    bool contains(const AlignedBox3& box) const override
     {
         if (!gte::InContainer(box.min, sphere))
             return false;
@@ -84,6 +86,22 @@ public:
         return true;
     }
 
+    Containment classify(const AlignedBox3& box) const override
+    {
+        return libzealand::classify(box,sphere);
+    }
+
+    AlignedBox3 getBoundingBox() const override
+    {
+        return libzealand::getBoundingBox(sphere);
+    }
+
+    // The sphere test costs the same for all 8 boxes, so inactive ones are not skipped
+    void classify8(const Box8& boxes, std::uint8_t, std::uint8_t& inside, std::uint8_t& partial) const override
+    {
+        libzealand::classify8(boxes,sphere,inside,partial);
+    }
+
     void updatePose(Real x, Real y, Real z,
                     Real r1c1, Real r1c2, Real r1c3, 
                     Real r2c1, Real r2c2, Real r2c3, 
@@ -96,7 +114,6 @@ public:
 protected:
 
     Sphere3 sphere;
-    gte::TIQuery<Real,AlignedBox3,Sphere3> query;
 };
 }
 
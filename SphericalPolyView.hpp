@@ -39,14 +39,16 @@ class SphericalPolyView : public RigidView
             Real c4 = gte::Dot(n4,center);
 
             planes.push_back({n1,c1});
-            planes.push_back({n2,c1});
-            planes.push_back({n3,c1});
-            planes.push_back({n4,c1});
+            planes.push_back({n2,c2});
+            planes.push_back({n3,c3});
+            planes.push_back({n4,c4});
 
             rays.push_back({center,v1});
             rays.push_back({center,v2});
             rays.push_back({center,v3});
             rays.push_back({center,v4});
+
+            this->center = center;
         }
 
         SphericalPolyView* clone() const override
@@ -54,62 +56,52 @@ class SphericalPolyView : public RigidView
             return new SphericalPolyView(*this);
         }
 
-        bool intersects (const AlignedBox3& box) override
+        // The pyramid is the intersection of the halfspaces normal.x >= constant.
+        // Conservative: a box is only outside if it is outside one of the planes.
+        bool intersects (const AlignedBox3& box) const override
         {
-            gte::TIQuery<Real,Ray3,AlignedBox3> query;
-            for (int i = 0; i < rays.size(); i++)
-            {
-                if (query(rays[i], box).intersect)
-                {
-                    // The box is partially covered.
-                    // It can't be fully covered since a corner
-                    // intersects the box
-                    return true;
-                    // Set to make the subsequent contains() check faster
-                    not_covered = true;
-                }
-            }
+            // A box crossed by an edge of the pyramid is partially covered
+            if (crossesEdge(box))
+                return true;
 
-            // If this point is reached, none of the rays intersect
-            // the box.
-            std::array<Vector3,8> vertices;
-            box.GetVertices(vertices);
+            std::array<Vector3,8> box_vertices;
+            box.GetVertices(box_vertices);
 
             for (int i = 0; i < planes.size(); i++)
             {
-                for (int j = 0; j < 8; j++)
-                {
-                    if (gte::Dot(planes[i].normal,vertices[i]) >= planes[i].constant)
-                        return true;
-                }
-            }
+                bool outside = true;
+                for (int j = 0; j < 8 && outside; j++)
+                    outside = gte::Dot(planes[i].normal,box_vertices[j]) < planes[i].constant;
 
-            return false;
+                if (outside)
+                    return false;
+            }
+            return true;
         }
 
-        // AHH! Not Implemented!
-        bool contains(const Vector3& vector) override
+        bool contains(const Vector3& vector) const override
         {
-            return 0;
+            for (int i = 0; i < planes.size(); i++)
+            {
+                if (gte::Dot(planes[i].normal,vector) < planes[i].constant)
+                    return false;
+            }
+            return true;
         }
 
-        bool contains (const AlignedBox3& box) override
+        bool contains (const AlignedBox3& box) const override
         {
-            if (not_covered)
-            {
-                not_covered = 0;
+            // It can't be fully covered if an edge crosses the box
+            if (crossesEdge(box))
                 return false;
-            }
-            else
+
+            std::array<Vector3,8> box_vertices;
+            box.GetVertices(box_vertices);
+
+            for (int j = 0; j < 8; j++)
             {
-                for (int i = 0; i < planes.size(); i++)
-                {
-                    for (int j = 0; j < 8; j++)
-                    {
-                        if (!gte::Dot(planes[i].normal,vertices[i]) >= planes[i].constant)
-                            return false;
-                    }
-                }
+                if (!contains(box_vertices[j]))
+                    return false;
             }
             return true;
         }
@@ -175,6 +167,17 @@ class SphericalPolyView : public RigidView
 
     protected:
 
+        bool crossesEdge(const AlignedBox3& box) const
+        {
+            gte::TIQuery<Real,Ray3,AlignedBox3> query;
+            for (int i = 0; i < rays.size(); i++)
+            {
+                if (query(rays[i], box).intersect)
+                    return true;
+            }
+            return false;
+        }
+
         // In sensor frame
         std::vector<Vector3> normals;
         std::vector<Vector3> vertices;
@@ -185,8 +188,6 @@ class SphericalPolyView : public RigidView
         // objects in inertial frame
         std::vector<Halfspace3> planes;
         std::vector<Ray3> rays;
-
-        bool not_covered;
 };
 }
 
@@ -0,0 +1,190 @@
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace libzealand
+{
+// Fixed-size work-stealing thread pool.
+// The calling thread takes part in every run() as worker 0,
+// so a pool of size 1 runs everything inline.
+class ThreadPool
+{
+    public:
+
+        using Task = std::function<void(std::size_t task, unsigned int worker)>;
+
+        ThreadPool() : ThreadPool(std::thread::hardware_concurrency())
+        {
+        }
+
+        ThreadPool(unsigned int num_threads) :
+        queues(num_threads == 0 ? 1 : num_threads)
+        {
+            for (int i = 0; i < queues.size(); i++)
+                queues[i] = std::make_unique<Queue>();
+
+            for (unsigned int i = 1; i < queues.size(); i++)
+                threads.emplace_back(&ThreadPool::workerLoop, this, i);
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stop = true;
+            }
+            start_cv.notify_all();
+
+            for (int i = 0; i < threads.size(); i++)
+                threads[i].join();
+        }
+
+        // Number of workers, including the calling thread
+        unsigned int size() const
+        {
+            return queues.size();
+        }
+
+        // Calls task(i, worker) for every i in [0, num_tasks) and blocks
+        // until all of them have finished. Tasks are dealt round-robin
+        // to the workers, and idle workers steal from the back of the
+        // other queues. The first exception thrown by a task is rethrown here.
+        void run(std::size_t num_tasks, const Task& task)
+        {
+            if (num_tasks == 0)
+                return;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+
+                for (std::size_t i = 0; i < num_tasks; i++)
+                {
+                    Queue& queue = *queues[i % queues.size()];
+                    std::lock_guard<std::mutex> queue_lock(queue.mutex);
+                    queue.tasks.push_back(i);
+                }
+
+                job = &task;
+                error = nullptr;
+                generation++;
+                active++;
+            }
+            start_cv.notify_all();
+
+            drain(0);
+
+            std::unique_lock<std::mutex> lock(mutex);
+            active--;
+            done_cv.wait(lock, [this]{ return active == 0; });
+            job = nullptr;
+
+            if (error)
+                std::rethrow_exception(error);
+        }
+
+    private:
+
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<std::size_t> tasks;
+        };
+
+        void workerLoop(unsigned int worker)
+        {
+            std::size_t seen = 0;
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true)
+            {
+                start_cv.wait(lock, [&]{ return stop || (job != nullptr && generation != seen); });
+                if (stop)
+                    return;
+
+                seen = generation;
+                active++;
+                lock.unlock();
+
+                drain(worker);
+
+                lock.lock();
+                active--;
+                if (active == 0)
+                    done_cv.notify_all();
+            }
+        }
+
+        // Run tasks from the worker's own queue, then steal
+        // from the others until every queue is empty
+        void drain(unsigned int worker)
+        {
+            std::size_t task;
+            while (popTask(worker, task))
+            {
+                try
+                {
+                    (*job)(task, worker);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!error)
+                        error = std::current_exception();
+                }
+            }
+        }
+
+        bool popTask(unsigned int worker, std::size_t& task)
+        {
+            // Own queue, oldest task first
+            {
+                Queue& own = *queues[worker];
+                std::lock_guard<std::mutex> lock(own.mutex);
+                if (!own.tasks.empty())
+                {
+                    task = own.tasks.front();
+                    own.tasks.pop_front();
+                    return true;
+                }
+            }
+
+            // Steal the newest task of another worker
+            for (int k = 1; k < queues.size(); k++)
+            {
+                Queue& victim = *queues[(worker + k) % queues.size()];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (!victim.tasks.empty())
+                {
+                    task = victim.tasks.back();
+                    victim.tasks.pop_back();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> threads;
+
+        std::mutex mutex;
+        std::condition_variable start_cv;
+        std::condition_variable done_cv;
+        const Task* job = nullptr;
+        std::size_t generation = 0;
+        unsigned int active = 0;
+        bool stop = false;
+        std::exception_ptr error;
+};
+}
+
+#endif
@@ -0,0 +1,205 @@
+#ifndef TimeSeries_hpp
+#define TimeSeries_hpp
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "Zealand.hpp"
+#include "RigidView.hpp"
+#include "ThreadPool.hpp"
+
+namespace libzealand
+{
+// Position and sensor to inertial rotation of a rigid view
+struct Pose
+{
+    Vector3 position;
+    Matrix3x3 rotation;
+};
+
+// Refines of a fixed set of shapes at a sequence of epochs, with some of the
+// shapes moving. Each worker moves its own clones of the moving shapes, so the
+// views passed in are never modified, and shares the rest.
+class TimeSeries
+{
+    public:
+
+        using PoseSource = std::function<Pose(Real epoch)>;
+
+        // Time steps refined and how long they took
+        struct Throughput
+        {
+            std::size_t steps;
+            Real seconds;
+            Real steps_per_second;
+        };
+
+        TimeSeries(const Zealand& octree, const std::vector<VolumeFOV*>& shapes,
+            const std::vector<VolumeFOV*>& not_shapes, int level) :
+        octree(octree), shapes(shapes), not_shapes(not_shapes), level(level)
+        {
+        }
+
+        // Move view, one of the shapes or not_shapes, to pose(epoch) at each epoch.
+        // pose is called from several threads at once.
+        void addSensor(RigidView* view, PoseSource pose)
+        {
+            for (Sensor& sensor : sensors)
+            {
+                if (getShape(sensor.index) == view)
+                {
+                    sensor.pose = std::move(pose);
+                    return;
+                }
+            }
+
+            for (std::size_t k = 0; k < shapes.size() + not_shapes.size(); k++)
+            {
+                if (getShape(k) == view)
+                {
+                    sensors.push_back({k, std::move(pose)});
+                    return;
+                }
+            }
+            throw std::invalid_argument("A sensor must be one of the shapes or not_shapes of the time series.");
+        }
+
+        // Refine at every epoch on pool and pass each result to
+        // reducer(step, epoch, coverage) in order of the steps. The reducer is
+        // called by one worker at a time, as soon as the steps before have been
+        // reduced, so a step waits in memory only while an earlier one is running.
+        template <class Reducer>
+        Throughput run(const std::vector<Real>& epochs, ThreadPool& pool, Reducer&& reducer) const
+        {
+            auto start = std::chrono::steady_clock::now();
+
+            std::vector<Worker> workers(pool.size());
+            for (Worker& worker : workers)
+                cloneShapes(worker);
+
+            // Results finished ahead of their turn, copied into buffers that are
+            // handed back to spare once reduced, so that each worker keeps the
+            // buffers of its refine context
+            std::vector<Coverage> waiting(epochs.size());
+            std::vector<char> ready(epochs.size(), 0);
+            std::vector<Coverage> spare;
+            std::size_t next = 0;
+            std::mutex mutex;
+
+            pool.run(epochs.size(), [&](std::size_t step, unsigned int w)
+            {
+                Worker& worker = workers[w];
+                for (const Sensor& sensor : sensors)
+                {
+                    Pose pose = sensor.pose(epochs[step]);
+                    const Matrix3x3& R = pose.rotation;
+                    worker.sensors[sensor.index]->updatePose(pose.position[0], pose.position[1], pose.position[2],
+                        R(0,0), R(0,1), R(0,2), R(1,0), R(1,1), R(1,2), R(2,0), R(2,1), R(2,2));
+                }
+
+                const Coverage& coverage = octree.refine(worker.context, worker.shapes, worker.not_shapes, level);
+
+                std::unique_lock<std::mutex> lock(mutex);
+                if (step != next)
+                {
+                    Coverage buffer;
+                    if (!spare.empty())
+                    {
+                        buffer = std::move(spare.back());
+                        spare.pop_back();
+                    }
+
+                    lock.unlock();
+                    buffer[0] = coverage[0];
+                    buffer[1] = coverage[1];
+                    lock.lock();
+
+                    waiting[step] = std::move(buffer);
+                    ready[step] = 1;
+
+                    // Unless the steps before were all reduced while copying
+                    if (step != next)
+                        return;
+                }
+                else
+                {
+                    // Only the worker holding step next can advance it
+                    lock.unlock();
+                    reducer(step, epochs[step], coverage);
+                    lock.lock();
+                    next++;
+                }
+
+                for (; next < epochs.size() && ready[next]; next++)
+                {
+                    Coverage result = std::move(waiting[next]);
+                    ready[next] = 0;
+
+                    lock.unlock();
+                    reducer(next, epochs[next], static_cast<const Coverage&>(result));
+                    lock.lock();
+
+                    spare.push_back(std::move(result));
+                }
+            });
+
+            Real seconds = std::chrono::duration<Real>(std::chrono::steady_clock::now() - start).count();
+            return {epochs.size(), seconds, epochs.size()/seconds};
+        }
+
+    private:
+
+        struct Sensor
+        {
+            std::size_t index; // into shapes followed by not_shapes
+            PoseSource pose;
+        };
+
+        struct Worker
+        {
+            std::vector<std::unique_ptr<RigidView>> owned;
+            std::vector<VolumeFOV*> shapes;
+            std::vector<VolumeFOV*> not_shapes;
+            std::vector<RigidView*> sensors; // clone of each sensor by index, otherwise null
+            RefineContext context;
+        };
+
+        VolumeFOV* getShape(std::size_t k) const
+        {
+            return k < shapes.size() ? shapes[k] : not_shapes[k - shapes.size()];
+        }
+
+        void cloneShapes(Worker& worker) const
+        {
+            std::size_t num_shapes = shapes.size() + not_shapes.size();
+            worker.sensors.assign(num_shapes, nullptr);
+            for (const Sensor& sensor : sensors)
+            {
+                worker.owned.emplace_back(static_cast<RigidView*>(getShape(sensor.index))->clone());
+                worker.sensors[sensor.index] = worker.owned.back().get();
+            }
+
+            // Views that do not move are shared
+            for (std::size_t k = 0; k < num_shapes; k++)
+            {
+                VolumeFOV* shape = worker.sensors[k] ? worker.sensors[k] : getShape(k);
+                if (k < shapes.size())
+                    worker.shapes.push_back(shape);
+                else
+                    worker.not_shapes.push_back(shape);
+            }
+        }
+
+        const Zealand& octree;
+        std::vector<VolumeFOV*> shapes;
+        std::vector<VolumeFOV*> not_shapes;
+        std::vector<Sensor> sensors;
+        int level;
+};
+}
+
+#endif
@@ -1,18 +1,60 @@
 #ifndef VolumeFOV_hpp
 #define VolumeFOV_hpp
 
+#include <limits>
+
 #include "util.hpp"
+#include "SimdClassify.hpp"
 
 namespace libzealand
 {
-// Abstract base class defining the intersection interface
+// Abstract base class defining the intersection interface.
+// The queries are const and reentrant, so one set of views can be
+// shared by every thread of a parallel refine. Views that need scratch
+// space keep it per thread rather than in the view.
 class VolumeFOV
 {
     public:
+        virtual ~VolumeFOV() = default;
         virtual VolumeFOV* clone() const = 0;
-        virtual bool intersects (const AlignedBox3& box) = 0;
-        virtual bool contains (const AlignedBox3& box) = 0;
-        virtual bool contains (const Vector3& point) = 0;
+        virtual bool intersects (const AlignedBox3& box) const = 0;
+        virtual bool contains (const AlignedBox3& box) const = 0;
+        virtual bool contains (const Vector3& point) const = 0;
+
+        // Tri-state test, equivalent to intersects() followed by contains().
+        // Views override this to share the geometry work between the two.
+        virtual Containment classify (const AlignedBox3& box) const
+        {
+            if (!intersects(box))
+                return OUTSIDE;
+            else if (contains(box))
+                return INSIDE;
+            return PARTIAL;
+        }
+
+        // Box holding every point of the volume. The default is unbounded,
+        // and bounded views override it so that refines can skip empty space.
+        virtual AlignedBox3 getBoundingBox () const
+        {
+            const Real inf = std::numeric_limits<Real>::infinity();
+            return AlignedBox3(Vector3({-inf, -inf, -inf}), Vector3({inf, inf, inf}));
+        }
+
+        // classify() for each of 8 boxes at once, as bit masks of the
+        // boxes inside and crossing the boundary. Boxes not in active
+        // may be skipped. Views override this with vectorized kernels.
+        virtual void classify8 (const Box8& boxes, std::uint8_t active, std::uint8_t& inside, std::uint8_t& partial) const
+        {
+            inside = 0;
+            partial = 0;
+            for (; active != 0; active &= active - 1)
+            {
+                int j = __builtin_ctz(active);
+                Containment c = classify(boxes.getBox(j));
+                inside |= (c == INSIDE) << j;
+                partial |= (c == PARTIAL) << j;
+            }
+        }
 };
 }
 
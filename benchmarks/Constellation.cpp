@@ -0,0 +1,80 @@
+#include <string>
+#include <vector>
+#include <chrono>
+#include <memory>
+#include <iostream>
+#include <stdlib.h>
+
+#include "VolumeFOV.hpp"
+#include "Zealand.hpp"
+#include "ConeView.hpp"
+#include "SphereView.hpp"
+
+// Compares one refine per satellite against a single
+// grouped refine of a Rider-like constellation
+int main(int argc, char *argv[])
+{
+    int level = argc > 1 ? atoi(argv[1]) : 7;
+    int num_sats = argc > 2 ? atoi(argv[2]) : 18;
+
+    Zealand octree(20000);
+
+    double theta = 2*M_PI/num_sats;
+    double r_t = 100 + 6378;
+    double r_s = 1883 + 6378;
+    double s_cone_angle = asin(r_t/r_s);
+    double b_cone_angle = s_cone_angle + 11.63*M_PI/180.0;
+
+    Vector3 center({0.0, 0.0, 0.0});
+    SphereView UTAS(center, 1000 + 6378);
+    SphereView LTAS(center, 200 + 6378);
+
+    std::vector<std::unique_ptr<VolumeFOV>> views;
+    std::vector<std::vector<VolumeFOV*>> group_shapes;
+    std::vector<std::vector<VolumeFOV*>> group_not_shapes;
+    for (int i = 0; i < num_sats; i++)
+    {
+        Vector3 v_s({r_s*sin(i*theta), 0.0, r_s*cos(i*theta)});
+        Vector3 axis = -v_s;
+        gte::Normalize(axis);
+
+        views.emplace_back(new ConeView(v_s, axis, b_cone_angle));
+        views.emplace_back(new SphereView(v_s, 6456));
+        views.emplace_back(new ConeView(v_s, axis, s_cone_angle));
+
+        group_shapes.push_back({views[3*i].get(), views[3*i + 1].get()});
+        group_not_shapes.push_back({views[3*i + 2].get()});
+    }
+
+    std::vector<VolumeFOV*> shared_shapes({&UTAS});
+    std::vector<VolumeFOV*> shared_not_shapes({&LTAS});
+
+    std::vector<Coverage> separate(num_sats);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < num_sats; i++)
+    {
+        std::vector<VolumeFOV*> shapes(group_shapes[i]);
+        shapes.insert(shapes.end(), shared_shapes.begin(), shared_shapes.end());
+        std::vector<VolumeFOV*> not_shapes(group_not_shapes[i]);
+        not_shapes.insert(not_shapes.end(), shared_not_shapes.begin(), shared_not_shapes.end());
+
+        separate[i] = octree.refineDepthFirst(shapes, not_shapes, level);
+    }
+    std::chrono::duration<double> separate_time = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    std::vector<Coverage> grouped = octree.refineGroups(group_shapes, group_not_shapes, shared_shapes, shared_not_shapes, level);
+    std::chrono::duration<double> grouped_time = std::chrono::steady_clock::now() - start;
+
+    std::cout << "Separate: " << separate_time.count() << " s" << std::endl;
+    std::cout << "Grouped:  " << grouped_time.count() << " s" << std::endl;
+    std::cout << "Speedup:  " << separate_time.count()/grouped_time.count() << std::endl;
+
+    if (separate != grouped)
+    {
+        std::cout << "Coverage mismatch!" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
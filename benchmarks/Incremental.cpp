@@ -0,0 +1,66 @@
+#include <string>
+#include <vector>
+#include <chrono>
+#include <memory>
+#include <iostream>
+#include <stdlib.h>
+
+#include "VolumeFOV.hpp"
+#include "Zealand.hpp"
+#include "SphereView.hpp"
+
+// Compares a fresh refine at every time step against the incremental
+// refine over a day of 100 second steps, as in profile/ZealandProf.cpp
+int main(int argc, char *argv[])
+{
+    int level = argc > 1 ? atoi(argv[1]) : 6;
+    int steps = argc > 2 ? atoi(argv[2]) : 864;
+
+    Zealand octree(17000.0);
+
+    Vector3 center({0.0, 0.0, 0.0});
+    double sma = 7000.0;
+    double mu = 398600.4418;
+    double dt = 100.0;
+    double n = sqrt(mu/(sma*sma*sma));
+
+    SphereView sphere_big(center, 6378.0 + 2000.0);
+    SphereView sphere_small(center, 6378.0 + 400.0);
+    SphereView sat(Vector3({0.0, 0.0, sma}), 5000);
+
+    std::vector<VolumeFOV*> shapes({&sat, &sphere_big});
+    std::vector<VolumeFOV*> not_shapes({&sphere_small});
+
+    std::chrono::duration<double> fresh_time(0);
+    std::chrono::duration<double> incremental_time(0);
+
+    Coverage cov = octree.refineDepthFirst(shapes, not_shapes, level);
+    for (int i = 1; i < steps; i++)
+    {
+        std::unique_ptr<SphereView> old_sat(sat.clone());
+        std::vector<VolumeFOV*> old_shapes({old_sat.get(), &sphere_big});
+
+        double theta = n*dt*i;
+        sat.updatePose(sma*sin(theta), 0, sma*cos(theta), 1, 0, 0, 0, 1, 0, 0, 0, 1);
+
+        auto start = std::chrono::steady_clock::now();
+        Coverage fresh = octree.refineDepthFirst(shapes, not_shapes, level);
+        fresh_time += std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        cov = octree.refineIncremental(cov, old_shapes, not_shapes, shapes, not_shapes, level);
+        incremental_time += std::chrono::steady_clock::now() - start;
+
+        if (cov != fresh)
+        {
+            std::cout << "Coverage mismatch at step " << i << "!" << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "Fresh:       " << fresh_time.count() << " s" << std::endl;
+    std::cout << "Incremental: " << incremental_time.count() << " s" << std::endl;
+    std::cout << "Speedup:     " << fresh_time.count()/incremental_time.count() << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include <string>
+#include <vector>
+#include <chrono>
+#include <iostream>
+#include <stdlib.h>
+
+#include "VolumeFOV.hpp"
+#include "Zealand.hpp"
+#include "ConeView.hpp"
+#include "SphereView.hpp"
+
+// Compares the polymorphic refine against the
+// compile-time shape pack refine on one Rider satellite
+int main(int argc, char *argv[])
+{
+    int level = atoi(argv[1]);
+    int repeats = argc > 2 ? atoi(argv[2]) : 10;
+
+    Zealand octree(20000);
+
+    double r_t = 100 + 6378;
+    double r_s = 1883 + 6378;
+    double s_cone_angle = asin(r_t/r_s);
+    double b_cone_angle = s_cone_angle + 11.63*M_PI/180.0;
+
+    Vector3 center({0.0, 0.0, 0.0});
+    Vector3 v_s({0.0, 0.0, r_s});
+    Vector3 axis = -v_s;
+    gte::Normalize(axis);
+
+    ConeView s_cone(v_s, axis, s_cone_angle);
+    ConeView b_cone(v_s, axis, b_cone_angle);
+    SphereView range(v_s, 6456);
+    SphereView UTAS(center, 1000 + 6378);
+    SphereView LTAS(center, 200 + 6378);
+
+    std::vector<VolumeFOV*> shapes({&b_cone, &range, &UTAS});
+    std::vector<VolumeFOV*> not_shapes({&s_cone, &LTAS});
+
+    Coverage cov_poly;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeats; i++)
+        cov_poly = octree.refine(shapes,not_shapes,level);
+    std::chrono::duration<double> poly = std::chrono::steady_clock::now() - start;
+
+    Coverage cov_pack;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeats; i++)
+        cov_pack = octree.refine(include(b_cone, range, UTAS), exclude(s_cone, LTAS), level);
+    std::chrono::duration<double> pack = std::chrono::steady_clock::now() - start;
+
+    std::cout << "Polymorphic: " << poly.count()/repeats << " s per refine" << std::endl;
+    std::cout << "Shape pack:  " << pack.count()/repeats << " s per refine" << std::endl;
+    std::cout << "Speedup:     " << poly.count()/pack.count() << std::endl;
+
+    if (cov_poly != cov_pack)
+    {
+        std::cout << "Coverage mismatch!" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
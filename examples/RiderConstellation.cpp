@@ -68,9 +68,15 @@ int main(void)
     std::vector<Blockset> partials(s);
 
     Zealand octree(20000);
+
+    Vector3 center({0.0, 0.0, 0.0});
+    VolumeFOV* UTAS = new SphereView(center, r_T_prime);
+    VolumeFOV* LTAS = new SphereView(center, r_T);
+
+    std::vector<std::vector<VolumeFOV*>> group_shapes(s);
+    std::vector<std::vector<VolumeFOV*>> group_not_shapes(s);
     for (int i = 0; i < s; i++)
     {
-        Vector3 center({0.0, 0.0, 0.0});
         Vector3 v_s({r_s*sin(i*theta),0.0,r_s*cos(i*theta)});
         Vector3 axis = -v_s; // need to normalize? 
         gte::Normalize(axis);
@@ -81,13 +87,19 @@ int main(void)
         VolumeFOV* b_cone = new ConeView(v_s, axis, b_cone_angle);
         VolumeFOV* range = new SphereView(v_s, R_max);
 
-        VolumeFOV* UTAS = new SphereView(center, r_T_prime);
-        VolumeFOV* LTAS = new SphereView(center, r_T);
+        group_shapes[i] = {b_cone, range};
+        group_not_shapes[i] = {s_cone};
+    }
 
-        std::vector<VolumeFOV*> shapes({b_cone, range, UTAS});
-        std::vector<VolumeFOV*> not_shapes({s_cone, LTAS});
+    // One pass over the octree for the whole constellation,
+    // testing the shared altitude shell once per block
+    std::vector<VolumeFOV*> shared_shapes({UTAS});
+    std::vector<VolumeFOV*> shared_not_shapes({LTAS});
+    std::vector<Coverage> covs = octree.refineGroups(group_shapes, group_not_shapes, shared_shapes, shared_not_shapes, level);
 
-        Coverage cov = octree.refine(shapes,not_shapes,level);
+    for (int i = 0; i < s; i++)
+    {
+        Coverage& cov = covs[i];
 
         IOUtils::print_blockset(octree,octree.alignedLeq(cov[0],1,y_slice),filename_partial[i]);
         IOUtils::print_blockset(octree,octree.alignedLeq(cov[1],1,y_slice),filename_full[i]);
@@ -21,10 +21,13 @@ int main(void)
     std::vector<VolumeFOV*> shapes({sat,sphere_big});
     std::vector<VolumeFOV*> not_shapes({sphere_small});
 
+    // Reuse the frontier buffers across time steps
+    RefineContext context;
+
     int level = 6;
     for (int i = 0; i < 864; i++)
     {
-        zealand.refine(shapes,not_shapes,level);
+        zealand.refine(context,shapes,not_shapes,level);
     }
 
     return 0;
@@ -1,15 +1,16 @@
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
 #include <vector>
-#include <algorithm>
-#include <iterator>
-#include <execution>
-#include <functional>
 
 #include "Zealand.hpp"
+#include "TimeSeries.hpp"
 #include "VolumeFOV.hpp"
 #include "SphereView.hpp"
 #include "ConeView.hpp"
 
-int main(void)
+int main(int argc, char** argv)
 {
     using namespace libzealand;
     Zealand zealand(17000.0, 17000.0, 17000.0);
@@ -20,20 +21,54 @@ int main(void)
     Vector3 position({0.0,0.0,sma});
     double range = 5000;
 
-    VolumeFOV* sphere_big = new SphereView(center,R);
-    VolumeFOV* sphere_small = new SphereView(center,r);
-    VolumeFOV* sat = new SphereView(position,range);
+    SphereView sphere_big(center,R);
+    SphereView sphere_small(center,r);
+    SphereView sat(position,range);
 
-    std::vector<VolumeFOV*> shapes({sat,sphere_big});
-    std::vector<VolumeFOV*> not_shapes({sphere_small});
+    std::vector<VolumeFOV*> shapes({&sat,&sphere_big});
+    std::vector<VolumeFOV*> not_shapes({&sphere_small});
 
     int level = 7;
-    std::vector<Coverage> results(864);
+    TimeSeries series(zealand, shapes, not_shapes, level);
 
-    std::transform(std::execution::par_unseq,results.begin(), results.end(), results.begin(), [&](const auto&) 
+    // One orbit in 864 steps
+    series.addSensor(&sat, [sma](Real epoch)
     {
-        return zealand.refine(shapes, not_shapes, level);
+        Real angle = 2*M_PI*epoch/864;
+        return Pose{Vector3({sma*sin(angle), 0.0, sma*cos(angle)}), Matrix3x3({1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0})};
     });
 
+    std::vector<Real> epochs;
+    for (int i = 0; i < 864; i++)
+        epochs.push_back(i);
+
+    // Throughput on 1, 2 and all threads, to see how the time series scales across cores
+    unsigned int max_threads = argc > 1 ? std::atoi(argv[1]) : std::thread::hardware_concurrency();
+    std::vector<unsigned int> thread_counts({1});
+    if (max_threads > 2)
+        thread_counts.push_back(2);
+    if (max_threads > 1)
+        thread_counts.push_back(max_threads);
+
+    Real serial_rate = 0;
+    for (unsigned int num_threads : thread_counts)
+    {
+        ThreadPool pool(num_threads);
+
+        Real volume = 0;
+        TimeSeries::Throughput throughput = series.run(epochs, pool,
+            [&](std::size_t, Real, const Coverage& coverage)
+        {
+            volume += zealand.getVolume(coverage[1]);
+        });
+
+        if (num_threads == 1)
+            serial_rate = throughput.steps_per_second;
+
+        std::cout << pool.size() << " threads: " << throughput.steps << " steps in " << throughput.seconds << " s, "
+            << throughput.steps_per_second << " steps/s, " << throughput.steps_per_second/serial_rate
+            << "x serial, mean full volume " << volume/epochs.size() << std::endl;
+    }
+
     return 0;
 }
@@ -73,6 +73,22 @@ TEST(IOUtils, test_print_blockset)
   IOUtils::print_blockset(octree,octree.alignedLeq(cov[1],0,x_slice),filename);
 }
 
+TEST(IOUtils, test_print_multiplicities)
+{
+  std::string filename = std::string(PROJECT_ROOT_DIR) + "/build/test/output/multiplicity_";
+
+  Rangeset bounds({{0,0},{5,0},{6,1},{9,1}});
+  Multiplicities multiplicities = toIntervals(bounds);
+  IOUtils::print_multiplicities(multiplicities, filename);
+
+  std::ifstream ifs(filename + "2.csv");
+  if (ifs.is_open())
+  {
+    std::vector<std::string> lines = IOUtils::read_n_lines(ifs, 1);
+    EXPECT_EQ(lines[0], "5,6");
+  }
+}
+
 // TEST(IOUtils, test_inputs_to_numeric_and_read_n_lines)
 // {
 //   const std::size_t num_lines = 10;
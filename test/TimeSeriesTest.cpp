@@ -0,0 +1,138 @@
+#include <chrono>
+#include <thread>
+
+#include "TimeSeries.hpp"
+#include "SphereView.hpp"
+#include "ConeView.hpp"
+#include "gtest/gtest.h"
+
+using namespace libzealand;
+
+// Circular orbit in the x-z plane, pointing at the origin
+Pose orbit(Real radius, Real epoch)
+{
+    Real angle = 2*M_PI*epoch/100.0;
+    Pose pose;
+    pose.position = Vector3({radius*sin(angle), 0.0, radius*cos(angle)});
+
+    // Rotation about y taking the sensor boresight +z to the nadir
+    Real c = cos(angle + M_PI), s = sin(angle + M_PI);
+    pose.rotation = Matrix3x3({c, 0.0, s, 0.0, 1.0, 0.0, -s, 0.0, c});
+    return pose;
+}
+
+void moveTo(RigidView* view, const Pose& pose)
+{
+    const Matrix3x3& R = pose.rotation;
+    view->updatePose(pose.position[0], pose.position[1], pose.position[2],
+        R(0,0), R(0,1), R(0,2), R(1,0), R(1,1), R(1,2), R(2,0), R(2,1), R(2,2));
+}
+
+// Every step matches a serial refine with the sensors moved by hand,
+// and the steps reach the reducer in order
+TEST(TimeSeriesTest, TestOrbit)
+{
+    Zealand octree(20000);
+
+    Real r_s = 1883 + 6378;
+    Vector3 center({0.0, 0.0, 0.0});
+    SphereView UTAS(center, 6378 + 1000);
+    SphereView LTAS(center, 6378 + 200);
+    SphereView range(Vector3({0.0, 0.0, r_s}), 6456);
+    ConeView horizon(Vector3({0.0, 0.0, r_s}), Vector3({0.0, 0.0, -1.0}), asin((6378 + 100)/r_s));
+
+    std::vector<VolumeFOV*> shapes({&range, &UTAS});
+    std::vector<VolumeFOV*> not_shapes({&horizon, &LTAS});
+
+    int level = 5;
+    TimeSeries series(octree, shapes, not_shapes, level);
+    series.addSensor(&range, [&](Real epoch){ return orbit(r_s, epoch); });
+    series.addSensor(&horizon, [&](Real epoch){ return orbit(r_s, epoch); });
+
+    std::vector<Real> epochs;
+    for (int i = 0; i < 40; i++)
+        epochs.push_back(2.5*i);
+
+    ThreadPool pool(4);
+    std::vector<std::size_t> steps;
+    std::vector<Coverage> results;
+    TimeSeries::Throughput throughput = series.run(epochs, pool,
+        [&](std::size_t step, Real epoch, const Coverage& coverage)
+    {
+        EXPECT_EQ(epoch, epochs[step]);
+        steps.push_back(step);
+        results.push_back(coverage);
+    });
+
+    EXPECT_EQ(throughput.steps, epochs.size());
+    EXPECT_GT(throughput.steps_per_second, 0);
+    ASSERT_EQ(steps.size(), epochs.size());
+    for (std::size_t i = 0; i < steps.size(); i++)
+        EXPECT_EQ(steps[i], i);
+
+    // The views passed in are left where they were
+    EXPECT_EQ(range.getBoundingBox().min[2], r_s - 6456);
+
+    std::unique_ptr<RigidView> moved_range(range.clone());
+    std::unique_ptr<RigidView> moved_horizon(horizon.clone());
+    std::vector<VolumeFOV*> moved_shapes({moved_range.get(), &UTAS});
+    std::vector<VolumeFOV*> moved_not_shapes({moved_horizon.get(), &LTAS});
+    for (std::size_t i = 0; i < epochs.size(); i++)
+    {
+        moveTo(moved_range.get(), orbit(r_s, epochs[i]));
+        moveTo(moved_horizon.get(), orbit(r_s, epochs[i]));
+        EXPECT_EQ(results[i], octree.refine(moved_shapes, moved_not_shapes, level));
+    }
+
+    // Sensors must be among the shapes
+    SphereView other(center, 1000);
+    EXPECT_THROW(series.addSensor(&other, [&](Real epoch){ return orbit(r_s, epoch); }), std::invalid_argument);
+}
+
+// Steps finished while an earlier one is still being reduced wait their turn,
+// and come out the same as when reduced straight away
+TEST(TimeSeriesTest, TestOutOfOrder)
+{
+    Zealand octree(20000);
+
+    Real r_s = 1883 + 6378;
+    SphereView UTAS(Vector3({0.0, 0.0, 0.0}), 6378 + 1000);
+    SphereView range(Vector3({0.0, 0.0, r_s}), 6456);
+
+    std::vector<VolumeFOV*> shapes({&range, &UTAS});
+    std::vector<VolumeFOV*> not_shapes;
+
+    TimeSeries series(octree, shapes, not_shapes, 4);
+    series.addSensor(&range, [&](Real epoch){ return orbit(r_s, epoch); });
+
+    std::vector<Real> epochs;
+    for (int i = 0; i < 24; i++)
+        epochs.push_back(4.0*i);
+
+    ThreadPool serial(1);
+    std::vector<Coverage> expected;
+    series.run(epochs, serial, [&](std::size_t, Real, const Coverage& coverage){ expected.push_back(coverage); });
+
+    ThreadPool pool(4);
+    std::vector<std::size_t> steps;
+    std::vector<Coverage> results;
+    series.run(epochs, pool, [&](std::size_t step, Real, const Coverage& coverage)
+    {
+        // Hold up the early steps so that later ones finish first
+        if (step % 8 == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        steps.push_back(step);
+        results.push_back(coverage);
+    });
+
+    ASSERT_EQ(steps.size(), epochs.size());
+    for (std::size_t i = 0; i < steps.size(); i++)
+        EXPECT_EQ(steps[i], i);
+    EXPECT_EQ(results, expected);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -369,6 +369,19 @@ TEST_F(ZealandTest, TestGetSmallestChild)
     EXPECT_EQ(expected_3, getSmallestChild(block,3));
 }
 
+TEST_F(ZealandTest, TestCurvePosition)
+{
+    // A level-0 block and its first and last level-1 children
+    unsigned long block = 0b1011;
+    Block8 children = getChildren(block);
+
+    EXPECT_EQ(curvePosition(block), getSmallestChild(block, MAX_LEVEL));
+    EXPECT_EQ(curvePosition(block), curvePosition(children[0]));
+    EXPECT_LT(curvePosition(children[0]), curvePosition(children[7]));
+    EXPECT_LT(curvePosition(children[7]), curvePosition(block + 1));
+    EXPECT_EQ(getLevel(curvePosition(children[7])), MAX_LEVEL);
+}
+
 TEST_F(ZealandTest, TestAppendChildren)
 {
     // Level-0 bottom-left block
@@ -521,7 +534,7 @@ TEST_F(ZealandTest, TestToIntervals_2)
     std::vector<std::vector<unsigned long>> multiplicities;
     multiplicities = toIntervals(interval_bounds);
 
-    std::vector<std::vector<unsigned long>> expected_multiplicities({{41,45,50,51},{12,28,31,40},{8,11,29,30},{6,7},{0,5},{},{},{}});
+    std::vector<std::vector<unsigned long>> expected_multiplicities({{41,45,50,51},{12,28,31,40},{8,11,29,30},{6,7},{0,5}});
 
     EXPECT_EQ(multiplicities, expected_multiplicities);
 }
@@ -536,11 +549,33 @@ TEST_F(ZealandTest, TestToIntervals_3)
     std::vector<std::vector<unsigned long>> multiplicities;
     multiplicities = toIntervals(interval_bounds);
 
-    std::vector<std::vector<unsigned long>> expected_multiplicities({{41, 45, 50, 51 },{ 12, 28, 31, 40 },{ 8, 11, 29, 30 },{},{ 0, 3, 6, 7 },{ 4, 4 },{ 5, 5 },{},{},{}});
+    std::vector<std::vector<unsigned long>> expected_multiplicities({{41, 45, 50, 51 },{ 12, 28, 31, 40 },{ 8, 11, 29, 30 },{},{ 0, 3, 6, 7 },{ 4, 4 },{ 5, 5 }});
 
     EXPECT_EQ(multiplicities, expected_multiplicities);
 }
 
+// The flat result holds the runs of each multiplicity one after another,
+// sized to the largest multiplicity that occurs
+TEST_F(ZealandTest, TestMultiplicities)
+{
+    Intervalset intervals({{0,45},{0,7},{7,30},{29,40},{0,5},{0,6},{0,11},{50,51},{4,7},{5,5}});
+    Rangeset interval_bounds = intervalSetToRangeSet(intervals);
+    std::sort(interval_bounds.begin(),interval_bounds.end());
+
+    Multiplicities multiplicities = toIntervals(interval_bounds);
+    ASSERT_EQ(multiplicities.size(), 7);
+    EXPECT_EQ(multiplicities.getOffsets(), std::vector<std::size_t>({0, 4, 8, 12, 12, 16, 18, 20}));
+    EXPECT_EQ(multiplicities.getBounds().size(), 20);
+
+    EXPECT_TRUE(multiplicities[3].empty());
+    std::span<const unsigned long> fifth = multiplicities[4];
+    EXPECT_EQ(std::vector<unsigned long>(fifth.begin(), fifth.end()), std::vector<unsigned long>({0, 3, 6, 7}));
+    EXPECT_THROW(multiplicities.at(7), std::out_of_range);
+
+    EXPECT_EQ(recombine(multiplicities[5]), Blockset({4}));
+    EXPECT_TRUE(toIntervals(Rangeset()).empty());
+}
+
 TEST_F(ZealandTest, TestToIntervalBounds)
 {
     // A somewhat arbitrary set of blocks 
@@ -640,6 +675,436 @@ TEST_F(ZealandTest, TestLocateRegion)
     }
 }
 
+TEST_F(ZealandTest, TestChildBoxes)
+{
+    Zealand octree(20000, 10000, 5000);
+
+    std::vector<unsigned long> blocks({1ul, 0b1101, 0b1101011, 0b1000111000});
+    for (int i = 0; i < blocks.size(); i++)
+    {
+        Box8 boxes;
+        octree.getChildBoxes(blocks[i], boxes);
+        Block8 children = getChildren(blocks[i]);
+
+        for (int j = 0; j < 8; j++)
+        {
+            AlignedBox3 box = octree.getAlignedBox(children[j]);
+            for (int k = 0; k < 3; k++)
+            {
+                EXPECT_EQ(boxes.min[k][j], box.min[k]);
+                EXPECT_EQ(boxes.max[k][j], box.max[k]);
+            }
+        }
+    }
+}
+
+TEST_F(ZealandTest, TestBoxCursor)
+{
+    Zealand octree(20000, 10000, 5000);
+    Zealand::BoxCursor cursor(octree);
+
+    // Mixed levels, out of order and repeated
+    Blockset blocks({0b1101011, 0b1101, 0b1101011, 0b1000111000, 0b1101010, 0b1000, 0b1111111111, 0b1000111000});
+    for (int i = 0; i < blocks.size(); i++)
+    {
+        AlignedBox3 expected = octree.getAlignedBox(blocks[i]);
+        AlignedBox3 box = cursor.getBox(blocks[i]);
+        Vector3 center = cursor.getCenter(blocks[i]);
+        for (int k = 0; k < 3; k++)
+        {
+            EXPECT_EQ(box.min[k], expected.min[k]);
+            EXPECT_EQ(box.max[k], expected.max[k]);
+            EXPECT_EQ(center[k], (expected.min[k] + expected.max[k])/2);
+        }
+    }
+
+    // The super-block is the whole octree
+    AlignedBox3 root = cursor.getBox(1ul);
+    Real scales[3] = {20000, 10000, 5000};
+    for (int k = 0; k < 3; k++)
+    {
+        EXPECT_EQ(root.min[k], -scales[k]/2);
+        EXPECT_EQ(root.max[k], scales[k]/2);
+    }
+}
+
+TEST_F(ZealandTest, TestClassify8)
+{
+    Zealand octree(20000);
+
+    Sphere3 sphere(Vector3({1000, -2000, 500}), 6000);
+    Cone3 cone(Ray3(Vector3({-500, 300, 200}), Vector3({0.6, 0.0, 0.8})), M_PI/6);
+    Cone3 frustum(Ray3(Vector3({-500, 300, 200}), Vector3({0.6, 0.0, 0.8})), M_PI/6, 3000, 12000);
+    Halfspace3 halfspace(Vector3({0.0, 0.6, -0.8}), 700);
+    gte::TIQuery<Real, AlignedBox3, Cone3> query;
+
+    // Every block of level 2
+    Blockset blocks;
+    appendChildren(1ul, blocks, 3);
+
+    for (int i = 0; i < blocks.size(); i++)
+    {
+        Box8 boxes;
+        octree.getChildBoxes(blocks[i], boxes);
+
+        std::uint8_t sphere_inside, sphere_partial;
+        std::uint8_t cone_inside, cone_partial;
+        std::uint8_t frustum_inside, frustum_partial;
+        std::uint8_t halfspace_inside, halfspace_partial;
+        classify8(boxes, sphere, sphere_inside, sphere_partial);
+        classify8(boxes, cone, query, 0xFF, cone_inside, cone_partial);
+        classify8(boxes, frustum, query, 0xFF, frustum_inside, frustum_partial);
+        classify8(boxes, halfspace, halfspace_inside, halfspace_partial);
+
+        for (int j = 0; j < 8; j++)
+        {
+            AlignedBox3 box = boxes.getBox(j);
+
+            Containment c = classify(box, sphere);
+            EXPECT_EQ((sphere_inside >> j) & 1, c == INSIDE);
+            EXPECT_EQ((sphere_partial >> j) & 1, c == PARTIAL);
+
+            c = classify(box, cone, query);
+            EXPECT_EQ((cone_inside >> j) & 1, c == INSIDE);
+            EXPECT_EQ((cone_partial >> j) & 1, c == PARTIAL);
+
+            // A frustum is classified by its vertices, which respect its height bounds
+            c = classify(box, frustum, query);
+            EXPECT_EQ(c, classifyByVertices(box, frustum, query));
+            EXPECT_EQ((frustum_inside >> j) & 1, c == INSIDE);
+            EXPECT_EQ((frustum_partial >> j) & 1, c == PARTIAL);
+
+            c = classify(box, halfspace);
+            EXPECT_EQ((halfspace_inside >> j) & 1, c == INSIDE);
+            EXPECT_EQ((halfspace_partial >> j) & 1, c == PARTIAL);
+        }
+    }
+}
+
+// Merging the trees of a forest gives the same runs
+// as sorting all of their bounds together
+TEST_F(ZealandTest, TestForestIntervals)
+{
+    // Disjoint blocks of mixed levels, out of Z-order, overlapping across trees,
+    // with one tree holding nested blocks and one empty
+    std::vector<Blockset> forest({
+        {0b1000001, 0b1000, 0b1111000, 0b1001, 0b1000000},
+        {0b1000, 0b1010, 0b1000011001},
+        {0b1001000111, 0b1, 0b1000111},
+        {},
+        {0b1010, 0b1010011, 0b1011, 0b1111}});
+
+    int largest_level = 0;
+    for (const Blockset& tree : forest)
+        if (!tree.empty())
+            largest_level = std::max(largest_level, getMaxLevel(tree));
+
+    Rangeset combined;
+    for (const Blockset& tree : forest)
+    {
+        if (tree.empty())
+            continue;
+        Rangeset bounds = toIntervalBounds(tree, largest_level);
+        combined.insert(combined.end(), bounds.begin(), bounds.end());
+    }
+    std::sort(combined.begin(), combined.end());
+    std::vector<std::vector<unsigned long>> expected = toIntervals(combined);
+
+    std::vector<std::vector<unsigned long>> multiplicities = toIntervals(forest);
+    EXPECT_GE(multiplicities.size(), forest.size());
+
+    // Equal up to the trailing multiplicities that never occur
+    std::size_t size = std::max(expected.size(), multiplicities.size());
+    expected.resize(size);
+    multiplicities.resize(size);
+    EXPECT_EQ(multiplicities, expected);
+
+    std::vector<std::vector<unsigned long>> none = toIntervals(std::vector<Blockset>(3));
+    EXPECT_EQ(none, std::vector<std::vector<unsigned long>>(3));
+}
+
+// Each threshold query matches the union of the multiplicities it keeps
+TEST_F(ZealandTest, TestThresholds)
+{
+    std::vector<Blockset> forest({
+        {0b1000001, 0b1000, 0b1111000, 0b1001, 0b1000000},
+        {0b1000, 0b1010, 0b1000011001},
+        {0b1001000111, 0b1000111},
+        {},
+        {0b1010, 0b1010011, 0b1011, 0b1111}});
+
+    Multiplicities multiplicities = toIntervals(forest);
+
+    // Sorted runs of the multiplicities kept, joined where they touch
+    auto expectedIntervals = [&](auto keep)
+    {
+        Intervalset runs;
+        for (std::size_t m = 1; m <= multiplicities.size(); m++)
+        {
+            if (!keep(m))
+                continue;
+            for (std::size_t i = 0; i < multiplicities[m-1].size(); i += 2)
+                runs.push_back({multiplicities[m-1][i], multiplicities[m-1][i+1]});
+        }
+        std::sort(runs.begin(), runs.end());
+
+        Intervalset joined;
+        for (const Interval& run : runs)
+        {
+            if (!joined.empty() && run[0] == joined.back()[1] + 1)
+                joined.back()[1] = run[1];
+            else
+                joined.push_back(run);
+        }
+        return joined;
+    };
+
+    for (int k = 1; k <= 4; k++)
+    {
+        Intervalset at_least = expectedIntervals([k](int m){ return m >= k; });
+        Intervalset exactly = expectedIntervals([k](int m){ return m == k; });
+        Intervalset at_most = expectedIntervals([k](int m){ return m <= k; });
+
+        EXPECT_EQ(atLeastKIntervals(forest, k), at_least);
+        EXPECT_EQ(exactlyKIntervals(forest, k), exactly);
+        EXPECT_EQ(atMostKIntervals(forest, k), at_most);
+
+        EXPECT_EQ(atLeastK(forest, k), recombine(at_least));
+        EXPECT_EQ(exactlyK(forest, k), recombine(exactly));
+        EXPECT_EQ(atMostK(forest, k), recombine(at_most));
+
+        EXPECT_DOUBLE_EQ(instance_.getVolumeAtLeastK(forest, k), instance_.getVolume(recombine(at_least)));
+        EXPECT_DOUBLE_EQ(instance_.getVolumeExactlyK(forest, k), instance_.getVolume(recombine(exactly)));
+        EXPECT_DOUBLE_EQ(instance_.getVolumeAtMostK(forest, k), instance_.getVolume(recombine(at_most)));
+    }
+
+    EXPECT_FALSE(atLeastKIntervals(forest, 2).empty());
+    EXPECT_TRUE(atLeastKIntervals(forest, 5).empty());
+    EXPECT_EQ(instance_.getVolumeAtLeastK(forest, 5), 0);
+}
+
+// Every interval is covered by exactly the trees of its set
+TEST_F(ZealandTest, TestSensorIntervals)
+{
+    std::vector<Blockset> forest({
+        {0b1000001, 0b1000, 0b1111000, 0b1001, 0b1000000},
+        {0b1000, 0b1010, 0b1000011001},
+        {0b1001000111, 0b1000111},
+        {},
+        {0b1010, 0b1010011, 0b1011, 0b1111}});
+    int level = 2; // finest level of the forest
+
+    auto covers = [&](const Blockset& tree, unsigned long position)
+    {
+        for (unsigned long block : tree)
+        {
+            int depth = level - getLevel(block);
+            if (getSmallestChild(block, depth) <= position && position <= getLargestChild(block, depth))
+                return true;
+        }
+        return false;
+    };
+
+    std::map<SensorSet, Intervalset> groups = toSensorIntervals(forest);
+    std::vector<Intervalset> by_size(forest.size() + 1);
+    for (const auto& [sensors, intervals] : groups)
+    {
+        EXPECT_FALSE(sensors.empty());
+        for (const Interval& interval : intervals)
+        {
+            EXPECT_EQ(getLevel(interval[0]), level);
+            for (unsigned long position = interval[0]; position <= interval[1]; position++)
+            {
+                for (std::size_t i = 0; i < forest.size(); i++)
+                    EXPECT_EQ(covers(forest[i], position), sensors.contains(i));
+            }
+        }
+    }
+
+    // Grouped by size, the sets give the multiplicities of trees without nested blocks
+    std::vector<Blockset> flat(forest);
+    flat[0] = {0b1000001, 0b1111000, 0b1001, 0b1000000};
+    flat[1] = {0b1000, 0b1010};
+    flat[4] = {0b1010, 0b1011, 0b1111};
+    for (const auto& [sensors, intervals] : toSensorIntervals(flat))
+        by_size[sensors.size()].insert(by_size[sensors.size()].end(), intervals.begin(), intervals.end());
+    for (std::size_t k = 1; k < by_size.size(); k++)
+    {
+        std::sort(by_size[k].begin(), by_size[k].end());
+        EXPECT_EQ(recombine(by_size[k]), recombine(exactlyKIntervals(flat, k)));
+    }
+
+    // Volume each tree covers alone
+    std::vector<Real> unique = instance_.getUniqueVolumes(forest);
+    ASSERT_EQ(unique.size(), forest.size());
+    for (std::size_t i = 0; i < forest.size(); i++)
+    {
+        SensorSet alone(forest.size());
+        alone.insert(i);
+        Real expected = groups.count(alone) ? instance_.getVolume(recombine(groups[alone])) : 0;
+        EXPECT_DOUBLE_EQ(unique[i], expected);
+    }
+    EXPECT_GT(unique[0], 0);
+    EXPECT_EQ(unique[3], 0);
+
+    // Past 64 trees the sets are lists of ids
+    std::vector<Blockset> wide(70);
+    wide[2] = {0b1000};
+    wide[65] = {0b1000, 0b1001};
+    wide[69] = {0b1001000};
+    std::map<SensorSet, Intervalset> wide_groups = toSensorIntervals(wide);
+    std::vector<std::vector<std::size_t>> sets;
+    for (const auto& [sensors, intervals] : wide_groups)
+        sets.push_back(sensors.getIds());
+    std::sort(sets.begin(), sets.end());
+    EXPECT_EQ(sets, std::vector<std::vector<std::size_t>>({{2, 65}, {65}, {65, 69}}));
+}
+
+// Summed weights match the sets of trees covering each interval
+TEST_F(ZealandTest, TestWeightedIntervals)
+{
+    std::vector<Blockset> forest({
+        {0b1000001, 0b1111000, 0b1001, 0b1000000},
+        {0b1000, 0b1010},
+        {0b1001000111, 0b1000111},
+        {},
+        {0b1010, 0b1011, 0b1111}});
+
+    // Powers of two, so each total names one set
+    std::vector<int> weights({1, 2, 4, 8, 16});
+    std::map<int, Intervalset> weighted = toWeightedIntervals(forest, weights);
+
+    std::map<int, Intervalset> expected;
+    for (const auto& [sensors, intervals] : toSensorIntervals(forest))
+    {
+        int total = 0;
+        for (std::size_t id : sensors.getIds())
+            total += weights[id];
+        expected[total] = intervals;
+    }
+    EXPECT_EQ(weighted, expected);
+
+    // Equal weights binned by one give the multiplicities
+    std::vector<Intervalset> bins = toWeightBins(forest, std::vector<int>(forest.size(), 1), std::vector<int>({1, 2, 3}));
+    ASSERT_EQ(bins.size(), 3);
+    EXPECT_EQ(bins[0], exactlyKIntervals(forest, 1));
+    EXPECT_EQ(bins[1], exactlyKIntervals(forest, 2));
+    EXPECT_EQ(bins[2], atLeastKIntervals(forest, 3));
+
+    std::vector<Real> quality({0.5, 1.0, 0.25, 2.0, 0.75});
+    std::vector<Real> edges({0.6, 1.2});
+    bins = toWeightBins(forest, quality, edges);
+    std::vector<Real> volumes = instance_.getWeightBinVolumes(forest, quality, edges);
+    ASSERT_EQ(volumes.size(), edges.size());
+    for (std::size_t i = 0; i < edges.size(); i++)
+        EXPECT_DOUBLE_EQ(volumes[i], instance_.getVolume(recombine(bins[i])));
+    EXPECT_GT(volumes[0], 0);
+    EXPECT_GT(volumes[1], 0);
+
+    EXPECT_THROW(toWeightedIntervals(forest, std::vector<int>({1, 2})), std::invalid_argument);
+}
+
+// Intervals running up to the last level-20 block, whose successor does not fit in 64 bits
+TEST_F(ZealandTest, TestSetOperations_CurveEnd)
+{
+    const unsigned long last = ~0ul;
+
+    Intervalset a({{last - 9, last - 5}, {last - 3, last - 1}});
+    Intervalset b({{last - 6, last}});
+    EXPECT_EQ(unite(a, b), Intervalset({{last - 9, last}}));
+    EXPECT_EQ(intersect(a, b), Intervalset({{last - 6, last - 5}, {last - 3, last - 1}}));
+    EXPECT_EQ(subtract(a, b), Intervalset({{last - 9, last - 7}}));
+    EXPECT_EQ(subtract(b, a), Intervalset({{last - 4, last - 4}, {last, last}}));
+    EXPECT_EQ(symmetricDifference(a, b), Intervalset({{last - 9, last - 7}, {last - 4, last - 4}, {last, last}}));
+
+    Intervalset second_last({{last - 1, last - 1}});
+    Intervalset both_last({{last - 1, last}});
+    EXPECT_EQ(intersect(second_last, both_last), second_last);
+    EXPECT_EQ(unite(second_last, both_last), both_last);
+    EXPECT_EQ(subtract(both_last, second_last), Intervalset({{last, last}}));
+
+    EXPECT_EQ(recombine(Intervalset({{last - 7, last}})), Blockset({last >> 3}));
+    EXPECT_EQ(unite(Blockset({last >> 3}), Blockset({last})), Blockset({last >> 3}));
+    EXPECT_EQ(toIntervalset(Blockset({last, last >> 3}), MAX_LEVEL), Intervalset({{last - 7, last}}));
+
+    // The sweeps over a forest end there too
+    std::vector<Blockset> forest({{last}, {last >> 3}});
+    std::map<SensorSet, Intervalset> groups = toSensorIntervals(forest);
+    ASSERT_EQ(groups.size(), 2);
+    SensorSet second(forest.size());
+    second.insert(1);
+    SensorSet both(second);
+    both.insert(0);
+    EXPECT_EQ(groups[second], Intervalset({{last - 7, last - 1}}));
+    EXPECT_EQ(groups[both], Intervalset({{last, last}}));
+    EXPECT_EQ(toWeightedIntervals(forest, std::vector<int>({1, 2})),
+        (std::map<int, Intervalset>({{2, {{last - 7, last - 1}}}, {3, {{last, last}}}})));
+
+    std::vector<Real> unique = instance_.getUniqueVolumes(forest);
+    EXPECT_EQ(unique[0], 0);
+    EXPECT_DOUBLE_EQ(unique[1], 7*instance_.getVolume(Blockset({last})));
+}
+
+// A normalized blockset is the coarsest sorted cover of its region,
+// whatever the order, duplicates and nesting of the input
+TEST_F(ZealandTest, TestNormalize)
+{
+    Sphere3 sphere(Vector3({0.05, 0.0, 0.0}), 0.3);
+    Coverage cov = instance_.refine(sphere, 6);
+
+    // Partial blocks after full ones and levels interleaved, as when concatenating coverages
+    Blockset blocks(cov[1]);
+    blocks.insert(blocks.end(), cov[0].begin(), cov[0].end());
+    Blockset expected = recombine(toIntervalset(blocks, 6));
+
+    Blockset normalized(blocks);
+    normalize(normalized);
+    EXPECT_EQ(normalized, expected);
+    EXPECT_DOUBLE_EQ(instance_.getVolume(normalized), instance_.getVolume(blocks));
+    EXPECT_LT(normalized.size(), blocks.size());
+
+    // Reversed, with duplicates and split blocks covered by their parents
+    Blockset messy(blocks.rbegin(), blocks.rend());
+    messy.insert(messy.end(), blocks.begin(), blocks.begin() + blocks.size()/2);
+    for (std::size_t i = 0; i < blocks.size(); i += 7)
+    {
+        Block8 children = getChildren(blocks[i]);
+        messy.insert(messy.end(), children.begin(), children.end());
+    }
+
+    Blockset radix_sorted(messy);
+    sortByCurvePosition(radix_sorted);
+    std::stable_sort(messy.begin(), messy.end(), [](unsigned long a, unsigned long b)
+    {
+        return curvePosition(a) < curvePosition(b) || (curvePosition(a) == curvePosition(b) && a < b);
+    });
+    EXPECT_EQ(radix_sorted, messy);
+
+    normalize(messy);
+    EXPECT_EQ(messy, expected);
+
+    // Already normalized
+    normalize(normalized);
+    EXPECT_EQ(normalized, expected);
+
+    // Complete siblings merge up to the root
+    Blockset all;
+    for (unsigned long block = 0b1000; block < 0b1111; block++)
+        all.push_back(block);
+    Block8 last = getChildren(0b1111);
+    all.insert(all.end(), last.rbegin(), last.rend());
+    normalize(all);
+    EXPECT_EQ(all, Blockset({1}));
+
+    Blockset incomplete({0b1000011, 0b1000, 0b1001000, 0b1001, 0b1000111});
+    normalize(incomplete);
+    EXPECT_EQ(incomplete, Blockset({0b1000, 0b1001}));
+
+    Blockset empty;
+    normalize(empty);
+    EXPECT_TRUE(empty.empty());
+}
+
 TEST_F(ZealandTest, TestIntervalToCells)
 {
     unsigned long start = 0b1000;
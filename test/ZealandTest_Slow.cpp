@@ -3,6 +3,7 @@
 #include "VolumeFOV.hpp"
 #include "SphereView.hpp"
 #include "ConeView.hpp"
+#include "SphericalPolyView.hpp"
 
 using namespace libzealand;
 
@@ -17,6 +18,88 @@ class ZealandTest : public ::testing::Test
         }
 
         Zealand instance_;
+
+        // Orbit radius of the Rider satellites and radius of the lower atmosphere
+        static constexpr Real rider_orbit = 1883 + 6378;
+        static constexpr Real LTAS_radius = 200 + 6378;
+
+        // One satellite of the Rider constellation. It sees the atmosphere
+        // between UTAS and LTAS inside its beam cone b_cone and range, but
+        // not inside the cone s_cone shadowed by the Earth.
+        struct RiderScene
+        {
+            ConeView b_cone;
+            SphereView range;
+            SphereView UTAS;
+            ConeView s_cone;
+            SphereView LTAS;
+
+            std::vector<VolumeFOV*> shapes()
+            {
+                return {&b_cone, &range, &UTAS};
+            }
+
+            std::vector<VolumeFOV*> not_shapes()
+            {
+                return {&s_cone, &LTAS};
+            }
+        };
+
+        // The satellite at angle about the y axis from the z axis, pointing at the Earth
+        static RiderScene riderScene(Real angle = 0)
+        {
+            Real r_t = 100 + 6378;
+            Real s_cone_angle = asin(r_t/rider_orbit);
+            Real b_cone_angle = s_cone_angle + 11.63*M_PI/180.0;
+
+            Vector3 center({0.0, 0.0, 0.0});
+            Vector3 v_s({rider_orbit*sin(angle), 0.0, rider_orbit*cos(angle)});
+            Vector3 axis = -v_s;
+            gte::Normalize(axis);
+
+            return {ConeView(v_s, axis, b_cone_angle), SphereView(v_s, 6456), SphereView(center, 1000 + 6378),
+                ConeView(v_s, axis, s_cone_angle), SphereView(center, LTAS_radius)};
+        }
+};
+
+// Counts the boxes classified by the wrapped view
+class CountingView : public VolumeFOV
+{
+    public:
+        CountingView(VolumeFOV* view) : view(view)
+        {
+        }
+
+        CountingView* clone() const override
+        {
+            return new CountingView(*this);
+        }
+
+        bool intersects(const AlignedBox3& box) const override
+        {
+            count++;
+            return view->intersects(box);
+        }
+
+        bool contains(const AlignedBox3& box) const override
+        {
+            count++;
+            return view->contains(box);
+        }
+
+        bool contains(const Vector3& point) const override
+        {
+            return view->contains(point);
+        }
+
+        Containment classify(const AlignedBox3& box) const override
+        {
+            count++;
+            return view->classify(box);
+        }
+
+        VolumeFOV* view;
+        mutable long count = 0;
 };
 
 // Check that two identical spheres create only
@@ -296,6 +379,282 @@ TEST_F(ZealandTest, TestHollowSphere)
 
 }
 
+// Refining to a volume tolerance must bracket the true volume
+// and stop as soon as the bracket is tight enough
+TEST_F(ZealandTest, TestHollowSphere_Tolerance)
+{
+    Vector3 center({0.0,0.0,0.0});
+    Real R = 16000.0/2.0;
+    Real r = 13000.0/2.0;
+
+    SphereView sphere_big(center,R);
+    SphereView sphere_small(center,r);
+
+    Real expected_volume = (4.0/3.0)*M_PI*(R*R*R - r*r*r);
+
+    std::vector<VolumeFOV*> shapes({&sphere_big});
+    std::vector<VolumeFOV*> not_shapes({&sphere_small});
+
+    Real relative = 0.05;
+    VolumeBounds bounds;
+    Coverage cov = instance_.refineToTolerance(shapes, not_shapes, 0, relative, MAX_LEVEL, bounds);
+
+    EXPECT_LE(bounds.lower, expected_volume);
+    EXPECT_GE(bounds.upper, expected_volume);
+    EXPECT_LE(bounds.upper - bounds.lower, relative*bounds.lower);
+    EXPECT_NEAR(bounds.lower, instance_.getVolume(cov[1]), 1e-9*expected_volume);
+    EXPECT_NEAR(bounds.upper, bounds.lower + instance_.getVolume(cov[0]), 1e-9*expected_volume);
+
+    // Stops part way through a level
+    int level = getLevel(cov[0].back());
+    EXPECT_LT(getLevel(cov[0].front()), level);
+
+    // One level less would not have been enough
+    Coverage coarse = instance_.refine(shapes, not_shapes, level - 1);
+    EXPECT_GT(instance_.getVolume(coarse[0]), relative*instance_.getVolume(coarse[1]));
+
+    // An unreachable tolerance refines every block to max_level
+    cov = instance_.refineToTolerance(shapes, not_shapes, 0, 0, 5, bounds);
+    Coverage fixed = instance_.refine(shapes, not_shapes, 5);
+    EXPECT_EQ(cov, fixed);
+    EXPECT_EQ(bounds.lower, instance_.getVolume(fixed[1]));
+}
+
+// The hook sees every level in turn and can stop the refine
+TEST_F(ZealandTest, TestHollowSphere_Progressive)
+{
+    Vector3 center({0.0,0.0,0.0});
+    SphereView sphere_big(center, 16000.0/2.0);
+    SphereView sphere_small(center, 13000.0/2.0);
+
+    std::vector<VolumeFOV*> shapes({&sphere_big});
+    std::vector<VolumeFOV*> not_shapes({&sphere_small});
+
+    int level = 6;
+    std::vector<int> levels;
+    Coverage cov = instance_.refineProgressive(shapes, not_shapes, level,
+        [&](int i, const VolumeBounds& bounds, const Coverage& coverage)
+    {
+        levels.push_back(i);
+
+        Coverage expected = instance_.refine(shapes, not_shapes, i);
+        EXPECT_EQ(coverage, expected);
+        EXPECT_NEAR(bounds.lower, instance_.getVolume(expected[1]), 1e-9*bounds.upper);
+        EXPECT_NEAR(bounds.upper, bounds.lower + instance_.getVolume(expected[0]), 1e-9*bounds.upper);
+        return true;
+    });
+
+    EXPECT_EQ(levels, std::vector<int>({0, 1, 2, 3, 4, 5, 6}));
+    EXPECT_EQ(cov, instance_.refine(shapes, not_shapes, level));
+
+    // Cancelled after level 3
+    cov = instance_.refineProgressive(shapes, not_shapes, level,
+        [](int i, const VolumeBounds& bounds, const Coverage& coverage){ return i < 3; });
+    EXPECT_EQ(cov, instance_.refine(shapes, not_shapes, 3));
+}
+
+// A block budget bounds the coverage size, and the volume
+// stays bracketed whatever order the blocks are refined in
+TEST_F(ZealandTest, TestHollowSphere_Budget)
+{
+    Vector3 center({0.0,0.0,0.0});
+    Real R = 16000.0/2.0;
+    Real r = 13000.0/2.0;
+
+    SphereView sphere_big(center,R);
+    SphereView sphere_small(center,r);
+
+    Real expected_volume = (4.0/3.0)*M_PI*(R*R*R - r*r*r);
+
+    std::vector<VolumeFOV*> shapes({&sphere_big});
+    std::vector<VolumeFOV*> not_shapes({&sphere_small});
+
+    std::size_t max_blocks = 5000;
+    int max_level = 8;
+    Vector3 focus({R, 0.0, 0.0});
+
+    Coverage largest = instance_.refineToBudget(shapes, not_shapes, max_blocks, max_level);
+    Coverage closest = instance_.refineToBudgetNear(shapes, not_shapes, max_blocks, max_level, focus);
+
+    for (Coverage* cov : {&largest, &closest})
+    {
+        EXPECT_LE((*cov)[0].size() + (*cov)[1].size(), max_blocks);
+        // Close to the budget, as a split adds at most 7 blocks
+        EXPECT_GT((*cov)[0].size() + (*cov)[1].size(), max_blocks - 7);
+
+        Real full_volume = instance_.getVolume((*cov)[1]);
+        EXPECT_LE(full_volume, expected_volume);
+        EXPECT_GE(full_volume + instance_.getVolume((*cov)[0]), expected_volume);
+    }
+
+    // Largest first leaves partial blocks on at most two levels
+    auto by_level = [](unsigned long a, unsigned long b){ return getLevel(a) < getLevel(b); };
+    auto [coarsest, finest] = std::minmax_element(largest[0].begin(), largest[0].end(), by_level);
+    EXPECT_LE(getLevel(*finest) - getLevel(*coarsest), 1);
+
+    // Closest first reaches max_level at the focus
+    Zealand::BoxCursor cursor(instance_);
+    bool refined_at_focus = false;
+    for (unsigned long block : closest[0])
+    {
+        AlignedBox3 box = cursor.getBox(block);
+        bool contains = true;
+        for (int i = 0; i < 3; i++)
+            contains = contains && box.min[i] <= focus[i] && focus[i] <= box.max[i];
+        refined_at_focus = refined_at_focus || (contains && getLevel(block) == max_level);
+    }
+    EXPECT_TRUE(refined_at_focus);
+    EXPECT_LT(getLevel(*std::min_element(closest[0].begin(), closest[0].end(), by_level)), getLevel(*coarsest));
+
+    // A budget that is never reached refines every block to max_level
+    Coverage unbounded = instance_.refineToBudget(shapes, not_shapes, std::size_t(-1), 5);
+    Coverage fixed = instance_.refine(shapes, not_shapes, 5);
+    for (int i = 0; i < 2; i++)
+    {
+        std::sort(unbounded[i].begin(), unbounded[i].end());
+        std::sort(fixed[i].begin(), fixed[i].end());
+    }
+    EXPECT_EQ(unbounded, fixed);
+}
+
+// Restricting a refine to a region keeps exactly the
+// coverage inside the region
+TEST_F(ZealandTest, TestHollowSphere_Region)
+{
+    Vector3 center({0.0,0.0,0.0});
+    SphereView sphere_big(center, 16000.0/2.0);
+    SphereView sphere_small(center, 13000.0/2.0);
+    SphereView sat(Vector3({0.0, 0.0, 7000.0}), 5000.0);
+
+    std::vector<VolumeFOV*> shapes({&sat});
+    std::vector<VolumeFOV*> not_shapes;
+
+    int level = 5;
+
+    // An altitude shell as a predicate matches the shell as shapes
+    RegionMask shell([&](const AlignedBox3& box)
+    {
+        Containment outer = sphere_big.classify(box);
+        Containment inner = sphere_small.classify(box);
+        if (outer == OUTSIDE || inner == INSIDE)
+            return OUTSIDE;
+        if (outer == INSIDE && inner == OUTSIDE)
+            return INSIDE;
+        return PARTIAL;
+    });
+
+    std::vector<VolumeFOV*> shell_shapes({&sat, &sphere_big});
+    std::vector<VolumeFOV*> shell_not_shapes({&sphere_small});
+    EXPECT_EQ(instance_.refine(shapes, not_shapes, shell, level),
+        instance_.refine(shell_shapes, shell_not_shapes, level));
+
+    // A blockset of mixed levels keeps the cells of the coverage inside it
+    Coverage ball = instance_.refine(std::vector<VolumeFOV*>({&sphere_small}), not_shapes, level - 2);
+    Blockset blocks = ball[1];
+    blocks.insert(blocks.end(), ball[0].begin(), ball[0].end());
+    RegionMask region(blocks);
+
+    auto cells = [&](const Blockset& blockset)
+    {
+        Blockset expanded;
+        for (unsigned long block : blockset)
+        {
+            int depth = level - getLevel(block);
+            for (unsigned long c = getSmallestChild(block, depth); c <= getLargestChild(block, depth); c++)
+                expanded.push_back(c);
+        }
+        std::sort(expanded.begin(), expanded.end());
+        return expanded;
+    };
+
+    Blockset region_cells = cells(blocks);
+    Coverage cov = instance_.refine(shapes, not_shapes, level);
+    Coverage restricted = instance_.refine(shapes, not_shapes, region, level);
+    for (int i = 0; i < 2; i++)
+    {
+        Blockset expected;
+        Blockset all = cells(cov[i]);
+        std::set_intersection(all.begin(), all.end(), region_cells.begin(), region_cells.end(),
+            std::back_inserter(expected));
+        EXPECT_EQ(cells(restricted[i]), expected);
+    }
+
+    // The same region as intervals on one level
+    Intervalset intervals;
+    for (unsigned long block : blocks)
+    {
+        int depth = level - getLevel(block);
+        intervals.push_back({getSmallestChild(block, depth), getLargestChild(block, depth)});
+    }
+    EXPECT_EQ(instance_.refine(shapes, not_shapes, RegionMask(intervals), level), restricted);
+
+    // Nothing is covered outside an empty region
+    Coverage none = instance_.refine(shapes, not_shapes, RegionMask(Blockset()), level);
+    EXPECT_TRUE(none[0].empty());
+    EXPECT_TRUE(none[1].empty());
+}
+
+// Boolean operations on the coverage of two overlapping spheres
+// match the same operations on their cells
+TEST_F(ZealandTest, TestSetOperations)
+{
+    SphereView sphere_a(Vector3({-1500.0, 0.0, 0.0}), 5000.0);
+    SphereView sphere_b(Vector3({1500.0, 1000.0, 0.0}), 4000.0);
+    std::vector<VolumeFOV*> none;
+
+    int level = 5;
+    Coverage cov_a = instance_.refine(std::vector<VolumeFOV*>({&sphere_a}), none, level);
+    Coverage cov_b = instance_.refineDepthFirst(std::vector<VolumeFOV*>({&sphere_b}), none, level);
+    Blockset a = cov_a[1];
+    Blockset b = cov_b[1];
+
+    auto cells = [&](const Blockset& blockset)
+    {
+        Blockset expanded;
+        for (unsigned long block : blockset)
+        {
+            int depth = level - getLevel(block);
+            for (unsigned long c = getSmallestChild(block, depth); c <= getLargestChild(block, depth); c++)
+                expanded.push_back(c);
+        }
+        std::sort(expanded.begin(), expanded.end());
+        return expanded;
+    };
+
+    Blockset cells_a = cells(a);
+    Blockset cells_b = cells(b);
+    Blockset expected;
+
+    std::set_union(cells_a.begin(), cells_a.end(), cells_b.begin(), cells_b.end(), std::back_inserter(expected));
+    EXPECT_EQ(cells(unite(a, b)), expected);
+
+    expected.clear();
+    std::set_intersection(cells_a.begin(), cells_a.end(), cells_b.begin(), cells_b.end(), std::back_inserter(expected));
+    Blockset both = intersect(a, b);
+    EXPECT_EQ(cells(both), expected);
+    EXPECT_FALSE(both.empty());
+
+    // The same blocks as the two-fold multiplicity
+    EXPECT_EQ(both, octreeMultiplicities({a, b})[1]);
+
+    expected.clear();
+    std::set_difference(cells_a.begin(), cells_a.end(), cells_b.begin(), cells_b.end(), std::back_inserter(expected));
+    EXPECT_EQ(cells(subtract(a, b)), expected);
+
+    expected.clear();
+    std::set_symmetric_difference(cells_a.begin(), cells_a.end(), cells_b.begin(), cells_b.end(), std::back_inserter(expected));
+    EXPECT_EQ(cells(symmetricDifference(a, b)), expected);
+
+    // Interval sets of the same blocks
+    Intervalset intervals_a = toIntervalset(a, level);
+    Intervalset intervals_b = toIntervalset(b, level);
+    EXPECT_EQ(recombine(intersect(intervals_a, intervals_b)), both);
+    EXPECT_EQ(unite(intervals_a, Intervalset()), intervals_a);
+    EXPECT_TRUE(subtract(intervals_a, intervals_a).empty());
+    EXPECT_EQ(symmetricDifference(intervals_a, intervals_b),
+        subtract(unite(intervals_a, intervals_b), intersect(intervals_a, intervals_b)));
+}
+
 // Test that the one-fold coverage multiplicity
 // from two nested spheres (the outer ring) has the same
 // volume when computed by CSG v. z-intersect method
@@ -408,7 +767,449 @@ TEST_F(ZealandTest, TestPolymorphicSphere)
     EXPECT_EQ(cov_poly[0].size(),cov[0].size());
     EXPECT_EQ(cov_poly[1].size(),cov[1].size());
 }
- 
+
+// The parallel refine must reproduce the serial
+// coverage block for block, in the same order
+TEST_F(ZealandTest, TestHollowSphere_Parallel)
+{
+    Vector3 center({0.0,0.0,0.0});
+    Real R = 16000.0/2.0;
+    Real r = 13000.0/2.0;
+
+    VolumeFOV* sphere_big = new SphereView(center,R);
+    VolumeFOV* sphere_small = new SphereView(center,r);
+
+    std::vector<VolumeFOV*> shapes({sphere_big});
+    std::vector<VolumeFOV*> not_shapes({sphere_small});
+
+    int level = 7;
+    Coverage cov = instance_.refine(shapes, not_shapes, level);
+
+    ThreadPool pool(4);
+    Coverage cov_par = instance_.refine(shapes, not_shapes, level, pool);
+
+    EXPECT_EQ(cov[0], cov_par[0]);
+    EXPECT_EQ(cov[1], cov_par[1]);
+
+    delete(sphere_big);
+    delete(sphere_small);
+}
+
+// A context reused across refines must give the same coverage
+// as single steps, and must not reallocate once it is large enough
+TEST_F(ZealandTest, TestHollowSphere_Context)
+{
+    Vector3 center({0.0,0.0,0.0});
+    SphereView sphere_big(center, 16000.0/2.0);
+    SphereView sphere_small(center, 13000.0/2.0);
+    SphereView sphere_shifted(Vector3({100.0, 0.0, 0.0}), 16000.0/2.0);
+
+    std::vector<VolumeFOV*> shapes({&sphere_big});
+    std::vector<VolumeFOV*> not_shapes({&sphere_small});
+
+    int level = 7;
+    Coverage cov({Blockset({1ul}), Blockset()});
+    for (int i = 0; i <= level; i++)
+        instance_.refine(cov, shapes, not_shapes);
+
+    RefineContext context;
+    EXPECT_EQ(instance_.refine(context, shapes, not_shapes, level), cov);
+
+    const unsigned long* partial = context.coverage[0].data();
+    const unsigned long* next = context.next.data();
+    const unsigned long* full = context.coverage[1].data();
+
+    EXPECT_EQ(instance_.refine(context, shapes, not_shapes, level), cov);
+    EXPECT_EQ(context.coverage[0].data(), partial);
+    EXPECT_EQ(context.next.data(), next);
+    EXPECT_EQ(context.coverage[1].data(), full);
+
+    // Nothing is left over from the previous refine
+    std::vector<VolumeFOV*> shifted({&sphere_shifted});
+    EXPECT_EQ(instance_.refine(context, shifted, not_shapes, level), instance_.refine(shifted, not_shapes, level));
+}
+
+// Same check for a single satellite of the Rider constellation
+TEST_F(ZealandTest, TestRider_Parallel)
+{
+    Zealand octree(20000);
+
+    RiderScene rider = riderScene();
+    std::vector<VolumeFOV*> shapes = rider.shapes();
+    std::vector<VolumeFOV*> not_shapes = rider.not_shapes();
+
+    int level = 7;
+    Coverage cov = octree.refine(shapes, not_shapes, level);
+
+    ThreadPool pool(3);
+    Coverage cov_par = octree.refine(shapes, not_shapes, level, pool);
+
+    EXPECT_EQ(cov[0], cov_par[0]);
+    EXPECT_EQ(cov[1], cov_par[1]);
+}
+
+// The depth-first refine must produce the same blocks
+// as the breadth-first refine, already sorted in Z-order
+TEST_F(ZealandTest, TestHollowSphere_DepthFirst)
+{
+    Vector3 center({0.0,0.0,0.0});
+    Real R = 16000.0/2.0;
+    Real r = 13000.0/2.0;
+
+    VolumeFOV* sphere_big = new SphereView(center,R);
+    VolumeFOV* sphere_small = new SphereView(center,r);
+
+    std::vector<VolumeFOV*> shapes({sphere_big});
+    std::vector<VolumeFOV*> not_shapes({sphere_small});
+
+    int level = 7;
+    Coverage cov = instance_.refine(shapes, not_shapes, level);
+    Coverage cov_dfs = instance_.refineDepthFirst(shapes, not_shapes, level);
+
+    auto z_order = [](unsigned long a, unsigned long b){ return curvePosition(a) < curvePosition(b); };
+    for (int i = 0; i < 2; i++)
+    {
+        EXPECT_TRUE(std::is_sorted(cov_dfs[i].begin(), cov_dfs[i].end(), z_order));
+
+        std::sort(cov[i].begin(), cov[i].end(), z_order);
+        EXPECT_EQ(cov[i], cov_dfs[i]);
+    }
+
+    // Partial and full leaves arrive interleaved in Z-order
+    unsigned long last = 0;
+    bool sorted = true;
+    instance_.refineDepthFirst(shapes, not_shapes, level, [&](unsigned long block, bool full)
+    {
+        sorted = sorted && curvePosition(block) > last;
+        last = curvePosition(block);
+    });
+    EXPECT_TRUE(sorted);
+
+    delete(sphere_big);
+    delete(sphere_small);
+}
+
+// A small sphere starts refining from its enclosing block,
+// giving the same coverage as a refine from the super-block
+TEST_F(ZealandTest, TestSmallSphere_StartBlock)
+{
+    Vector3 center({2500.0, 2500.0, 2500.0});
+    SphereView sphere_big(center, 1000.0);
+    SphereView sphere_small(center, 400.0);
+
+    std::vector<VolumeFOV*> shapes({&sphere_big});
+    std::vector<VolumeFOV*> not_shapes({&sphere_small});
+
+    // Bounding box [1500,3500]^3 fits in the first child of the +x+y+z octant
+    unsigned long enclosing = instance_.getEnclosingBlock(shapes);
+    EXPECT_EQ(enclosing, 0b1111000ul);
+
+    int level = 7;
+    Coverage cov({Blockset({1ul}), Blockset()});
+    for (int i = 0; i <= level; i++)
+        instance_.refine(cov, shapes, not_shapes);
+
+    EXPECT_EQ(instance_.refine(shapes, not_shapes, level), cov);
+
+    ThreadPool pool(2);
+    EXPECT_EQ(instance_.refine(shapes, not_shapes, level, pool), cov);
+
+    Coverage cov_dfs = instance_.refineDepthFirst(shapes, not_shapes, level);
+    auto z_order = [](unsigned long a, unsigned long b){ return curvePosition(a) < curvePosition(b); };
+    for (int i = 0; i < 2; i++)
+    {
+        std::sort(cov[i].begin(), cov[i].end(), z_order);
+        EXPECT_EQ(cov[i], cov_dfs[i]);
+    }
+
+    // Shapes with no point in common cover nothing
+    SphereView sphere_far(Vector3({-2500.0, 2500.0, 2500.0}), 1000.0);
+    std::vector<VolumeFOV*> disjoint({&sphere_big, &sphere_far});
+    EXPECT_EQ(instance_.getEnclosingBlock(disjoint), 0ul);
+
+    Coverage empty = instance_.refine(disjoint, not_shapes, level);
+    EXPECT_TRUE(empty[0].empty());
+    EXPECT_TRUE(empty[1].empty());
+    empty = instance_.refineDepthFirst(disjoint, not_shapes, level);
+    EXPECT_TRUE(empty[0].empty());
+    EXPECT_TRUE(empty[1].empty());
+}
+
+// The lazy refine yields the depth-first leaves one at a time
+// and feeds a ranges pipeline
+TEST_F(ZealandTest, TestHollowSphere_Lazy)
+{
+    Vector3 center({0.0,0.0,0.0});
+    SphereView sphere_big(center, 16000.0/2.0);
+    SphereView sphere_small(center, 13000.0/2.0);
+
+    std::vector<VolumeFOV*> shapes({&sphere_big});
+    std::vector<VolumeFOV*> not_shapes({&sphere_small});
+
+    int level = 6;
+    std::vector<std::pair<unsigned long,bool>> expected;
+    instance_.refineDepthFirst(shapes, not_shapes, level, [&](unsigned long block, bool full)
+    {
+        expected.emplace_back(block, full);
+    });
+
+    // The shape lists may be temporaries
+    std::vector<std::pair<unsigned long,bool>> leaves;
+    for (CoverageBlock leaf : instance_.refineLazy({&sphere_big}, {&sphere_small}, level))
+        leaves.emplace_back(leaf.block, leaf.full);
+    EXPECT_EQ(leaves, expected);
+
+    // Boxes of the full blocks in the lower half
+    Coverage cov = instance_.refineDepthFirst(shapes, not_shapes, level);
+    std::vector<AlignedBox3> expected_boxes;
+    for (unsigned long block : instance_.alignedLeq(cov[1], 2, 0.0))
+        expected_boxes.push_back(instance_.getAlignedBox(block));
+
+    auto boxes = instance_.refineLazy(shapes, not_shapes, level)
+        | std::views::filter([](const CoverageBlock& leaf){ return leaf.full; })
+        | std::views::filter([&](const CoverageBlock& leaf){ return instance_.alignedLeq(leaf.block, 2, 0.0); })
+        | std::views::transform([&](const CoverageBlock& leaf){ return instance_.getAlignedBox(leaf.block); });
+
+    std::size_t n = 0;
+    for (const AlignedBox3& box : boxes)
+    {
+        ASSERT_LT(n, expected_boxes.size());
+        EXPECT_EQ(box, expected_boxes[n++]);
+    }
+    EXPECT_EQ(n, expected_boxes.size());
+
+    // Stopping early leaves the rest unrefined
+    auto first = instance_.refineLazy(shapes, not_shapes, level) | std::views::take(3);
+    EXPECT_EQ(std::ranges::distance(first.begin(), first.end()), 3);
+}
+
+// classify() must agree with intersects() followed by contains()
+TEST_F(ZealandTest, TestClassify)
+{
+    Vector3 center({1000.0,-500.0,250.0});
+    Vector3 direction({0.0,0.6,0.8});
+
+    VolumeFOV* sphere = new SphereView(center,5000.0);
+    VolumeFOV* cone = new ConeView(center,direction,M_PI/8);
+    VolumeFOV* gte_sphere = new GTEFOV<Sphere3>(Sphere3(center,5000.0));
+    VolumeFOV* frustum = new GTEFOV<Cone3>(Cone3(Ray3(center,direction),M_PI/8,2000.0,9000.0));
+    std::vector<VolumeFOV*> shapes({sphere, cone, gte_sphere, frustum});
+
+    // Every block of level 3
+    Blockset blocks;
+    appendChildren(1ul, blocks, 4);
+
+    for (VolumeFOV* shape : shapes)
+    {
+        for (int i = 0; i < blocks.size(); i++)
+        {
+            AlignedBox3 box = instance_.getAlignedBox(blocks[i]);
+
+            Containment expected = OUTSIDE;
+            if (shape->intersects(box))
+                expected = shape->contains(box) ? INSIDE : PARTIAL;
+
+            EXPECT_EQ(shape->classify(box), expected);
+        }
+        delete(shape);
+    }
+}
+
+// A square pyramid along +z with its apex at the origin
+TEST_F(ZealandTest, TestSphericalPolyView)
+{
+    Vector3 apex({0.0, 0.0, 0.0});
+    const SphericalPolyView pyramid(apex, Vector3({1.0, 1.0, 1.0}), Vector3({-1.0, 1.0, 1.0}),
+        Vector3({-1.0, -1.0, 1.0}), Vector3({1.0, -1.0, 1.0}));
+
+    AlignedBox3 ahead(Vector3({-100.0, -100.0, 5000.0}), Vector3({100.0, 100.0, 5100.0}));
+    AlignedBox3 behind(Vector3({-100.0, -100.0, -5100.0}), Vector3({100.0, 100.0, -5000.0}));
+    AlignedBox3 edge(Vector3({2900.0, 2900.0, 2900.0}), Vector3({3100.0, 3100.0, 3100.0}));
+
+    EXPECT_TRUE(pyramid.contains(Vector3({0.0, 0.0, 1.0})));
+    EXPECT_FALSE(pyramid.contains(Vector3({0.0, 0.0, -1.0})));
+
+    EXPECT_EQ(pyramid.classify(ahead), INSIDE);
+    EXPECT_EQ(pyramid.classify(behind), OUTSIDE);
+    EXPECT_EQ(pyramid.classify(edge), PARTIAL);
+}
+
+// Carrying the undecided shapes down the tree must not change
+// the coverage, and settled shapes must not be tested again
+TEST_F(ZealandTest, TestRider_ActiveShapes)
+{
+    Zealand octree(20000);
+
+    RiderScene rider = riderScene();
+    std::vector<VolumeFOV*> views = rider.shapes();
+    for (VolumeFOV* view : rider.not_shapes())
+        views.push_back(view);
+    std::vector<CountingView> counters(views.begin(), views.end());
+
+    std::vector<VolumeFOV*> shapes({&counters[0], &counters[1], &counters[2]});
+    std::vector<VolumeFOV*> not_shapes({&counters[3], &counters[4]});
+
+    int level = 7;
+
+    // Every shape tested against every child
+    Coverage cov({Blockset({1ul}), Blockset()});
+    for (int i = 0; i <= level; i++)
+        octree.refine(cov, shapes, not_shapes);
+
+    long all_calls = 0;
+    for (int i = 0; i < counters.size(); i++)
+    {
+        all_calls += counters[i].count;
+        counters[i].count = 0;
+    }
+
+    Coverage cov_active = octree.refine(shapes, not_shapes, level);
+
+    long active_calls = 0;
+    for (int i = 0; i < counters.size(); i++)
+        active_calls += counters[i].count;
+
+    EXPECT_EQ(cov[0], cov_active[0]);
+    EXPECT_EQ(cov[1], cov_active[1]);
+    EXPECT_LT(2*active_calls, all_calls);
+}
+
+TEST_F(ZealandTest, TestTooManyShapes)
+{
+    VolumeFOV* sphere = new SphereView(Vector3({0.0,0.0,0.0}), 1000.0);
+    std::vector<VolumeFOV*> shapes(40, sphere);
+    std::vector<VolumeFOV*> not_shapes(25, sphere);
+
+    EXPECT_THROW(instance_.refine(shapes, not_shapes, 2), std::invalid_argument);
+
+    // A lazy refine throws when it starts running
+    Generator<CoverageBlock> leaves = instance_.refineLazy(shapes, not_shapes, 2);
+    EXPECT_THROW(leaves.begin(), std::invalid_argument);
+
+    delete(sphere);
+}
+
+// Compile-time shape packs must reproduce the polymorphic refine
+TEST_F(ZealandTest, TestRider_ShapePack)
+{
+    Zealand octree(20000);
+
+    RiderScene rider = riderScene();
+    std::vector<VolumeFOV*> shapes = rider.shapes();
+    std::vector<VolumeFOV*> not_shapes = rider.not_shapes();
+
+    // Bare GTE primitives can be mixed with views
+    Sphere3 LTAS(Vector3({0.0, 0.0, 0.0}), LTAS_radius);
+
+    int level = 7;
+    Coverage cov = octree.refine(shapes, not_shapes, level);
+    Coverage cov_pack = octree.refine(include(rider.b_cone, rider.range, rider.UTAS), exclude(rider.s_cone, LTAS), level);
+
+    EXPECT_EQ(cov[0], cov_pack[0]);
+    EXPECT_EQ(cov[1], cov_pack[1]);
+
+    // Nothing excluded
+    not_shapes.clear();
+    cov = octree.refine(shapes, not_shapes, level);
+    cov_pack = octree.refine(include(rider.b_cone, rider.range, rider.UTAS), exclude(), level);
+
+    EXPECT_EQ(cov[0], cov_pack[0]);
+    EXPECT_EQ(cov[1], cov_pack[1]);
+}
+
+// Incremental refine of a moving satellite must match a fresh refine at every step
+TEST_F(ZealandTest, TestRider_Incremental)
+{
+    Zealand octree(20000);
+
+    RiderScene rider = riderScene();
+    std::vector<RigidView*> moving({&rider.b_cone, &rider.range, &rider.s_cone});
+    std::vector<VolumeFOV*> shapes = rider.shapes();
+    std::vector<VolumeFOV*> not_shapes = rider.not_shapes();
+
+    int level = 7;
+    Coverage cov = octree.refineDepthFirst(shapes, not_shapes, level);
+
+    for (int step = 1; step <= 5; step++)
+    {
+        // Keep the old poses
+        std::vector<std::unique_ptr<RigidView>> old(moving.size());
+        for (int i = 0; i < moving.size(); i++)
+            old[i].reset(moving[i]->clone());
+
+        std::vector<VolumeFOV*> old_shapes({old[0].get(), old[1].get(), &rider.UTAS});
+        std::vector<VolumeFOV*> old_not_shapes({old[2].get(), &rider.LTAS});
+
+        // Rotate about the y axis along a circular orbit
+        Real theta = 0.02*step;
+        Real c = cos(theta);
+        Real s = sin(theta);
+        for (int i = 0; i < moving.size(); i++)
+            moving[i]->updatePose(rider_orbit*s, 0, rider_orbit*c, c, 0, s, 0, 1, 0, -s, 0, c);
+
+        // Blocks passed to a sink arrive in Z-order, as in refineDepthFirst
+        std::vector<unsigned long> streamed;
+        octree.refineIncremental(cov, old_shapes, old_not_shapes, shapes, not_shapes, level,
+            [&streamed](unsigned long block, bool full){ streamed.push_back(block); });
+        EXPECT_TRUE(std::is_sorted(streamed.begin(), streamed.end(),
+            [](unsigned long a, unsigned long b){ return curvePosition(a) < curvePosition(b); }));
+
+        cov = octree.refineIncremental(cov, old_shapes, old_not_shapes, shapes, not_shapes, level);
+        Coverage fresh = octree.refineDepthFirst(shapes, not_shapes, level);
+
+        EXPECT_EQ(cov[0], fresh[0]);
+        EXPECT_EQ(cov[1], fresh[1]);
+        EXPECT_EQ(streamed.size(), fresh[0].size() + fresh[1].size());
+    }
+
+    // Nothing moved
+    Coverage same = octree.refineIncremental(cov, shapes, not_shapes, shapes, not_shapes, level);
+    EXPECT_EQ(same, cov);
+
+    EXPECT_THROW(octree.refineIncremental(cov, shapes, {}, shapes, not_shapes, level), std::invalid_argument);
+}
+
+// A single pass over a constellation must match refining each satellite separately
+TEST_F(ZealandTest, TestRiderConstellation_Groups)
+{
+    Zealand octree(20000);
+
+    int num_sats = 6;
+    Real theta = (360.0/num_sats)*M_PI/180.0;
+
+    std::vector<RiderScene> riders;
+    for (int i = 0; i < num_sats; i++)
+        riders.push_back(riderScene(i*theta));
+
+    // The atmosphere shells are shared by every satellite
+    std::vector<std::vector<VolumeFOV*>> group_shapes;
+    std::vector<std::vector<VolumeFOV*>> group_not_shapes;
+    for (RiderScene& rider : riders)
+    {
+        group_shapes.push_back({&rider.b_cone, &rider.range});
+        group_not_shapes.push_back({&rider.s_cone});
+    }
+
+    std::vector<VolumeFOV*> shared_shapes({&riders[0].UTAS});
+    std::vector<VolumeFOV*> shared_not_shapes({&riders[0].LTAS});
+
+    int level = 7;
+    std::vector<Coverage> covs = octree.refineGroups(group_shapes, group_not_shapes, shared_shapes, shared_not_shapes, level);
+    ASSERT_EQ(covs.size(), num_sats);
+
+    for (int i = 0; i < num_sats; i++)
+    {
+        Coverage cov = octree.refineDepthFirst(riders[i].shapes(), riders[i].not_shapes(), level);
+        EXPECT_EQ(covs[i][0], cov[0]);
+        EXPECT_EQ(covs[i][1], cov[1]);
+    }
+
+    // No shared shapes
+    covs = octree.refineGroups(group_shapes, group_not_shapes, {}, {}, level);
+    Coverage cov = octree.refineDepthFirst(group_shapes[0], group_not_shapes[0], level);
+    EXPECT_EQ(covs[0], cov);
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
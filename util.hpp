@@ -1,10 +1,18 @@
 #ifndef util_hpp
 #define util_hpp
 
+#include <array>
 #include <bitset>
 #include <vector>
 #include <iostream>
 #include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
 
 #include "morton.h"
 #include "Mathematics/Vector.h"
@@ -43,6 +51,32 @@ namespace libzealand
     using Intervalset = std::vector<Interval>;
     const int MAX_LEVEL = 20;
 
+    // One bit per shape, set while a block is undecided against it
+    using ShapeMask = std::uint64_t;
+    const int MAX_SHAPES = 64;
+
+    // Relation of a box to a shape
+    enum Containment
+    {
+        OUTSIDE, // no point of the box is in the shape
+        PARTIAL, // the box crosses the boundary of the shape
+        INSIDE   // the whole box is in the shape
+    };
+
+    // Leaf of a coverage as a refine produces it
+    struct CoverageBlock
+    {
+        unsigned long block;
+        bool full; // wholly covered rather than partially
+    };
+
+    // Bounds on the volume of a region from its full and partial blocks
+    struct VolumeBounds
+    {
+        Real lower; // volume of the full blocks
+        Real upper; // volume of the full and partial blocks
+    };
+
     inline unsigned int getBlocksDim(unsigned int level)
     {
         //return pow(2,level+1);
@@ -104,6 +138,27 @@ namespace libzealand
         return (block << 3*depth) | set3NBits(depth);
     }
 
+    // Position of a block on the level-20 Morton curve.
+    // Ordering blocks of mixed levels by this key
+    // sorts them in Z-order, parents before their first child.
+    inline unsigned long curvePosition(unsigned long block)
+    {
+        return getSmallestChild(block, MAX_LEVEL - getLevel(block));
+    }
+
+    // Deepest level of any block in the blockset
+    inline int getMaxLevel(const Blockset& blockset)
+    {
+        int max_level = 0;
+        for (int i = 0; i < blockset.size(); i++)
+        {
+            int level = getLevel(blockset[i]);
+            if (level > max_level)
+                max_level = level;
+        }
+        return max_level;
+    }
+
     inline Range getRangeStart(unsigned long block, int depth)
     {
         unsigned long smallest_child = getSmallestChild(block,depth);
@@ -124,7 +179,7 @@ namespace libzealand
         if (blockset.size() == 0)
             std::cout << "Exception" << std::endl;
 
-        int max_level = getLevel(blockset.back());
+        int max_level = getMaxLevel(blockset);
         Rangeset intervals;
 
         for (int i = 0; i < blockset.size(); i++)
@@ -186,7 +241,7 @@ namespace libzealand
             std::cout << "Exception" << std::endl;
 
         Blockset collapsed;
-        int max_level = getLevel(blockset.back());
+        int max_level = getMaxLevel(blockset);
 
         if (max_level < level)
         {
@@ -219,166 +274,733 @@ namespace libzealand
         return ranges;
     }
 
-    inline std::vector<std::vector<unsigned long>> toIntervals(const Rangeset& interval_bounds)
+    // Bound of a half-open run of blocks [start, stop + 1) on one level.
+    // One past the last level-20 block ~0ul does not fit in 64 bits,
+    // so it is flagged rather than wrapped around to 0.
+    struct HalfOpenBound
     {
-        int max_multiplicity = interval_bounds.size()/2;
-        std::vector<std::vector<unsigned long>> multiplicities(max_multiplicity);
+        bool past_end = false;
+        unsigned long position = 0;
 
-        bool run = false;
-        int run_mult = 0;
-        unsigned long run_start;
-        int multiplicity = 0;
-        int i;
-        for (i = 0; i < interval_bounds.size() - 1; i++)
+        auto operator<=>(const HalfOpenBound& other) const = default;
+
+        // Last block before the bound, ~0ul for the one past the end
+        unsigned long last() const
         {
-            unsigned long block = interval_bounds[i].first;
-            if (interval_bounds[i].second == 0) // open
+            return position - 1;
+        }
+    };
+
+    // First block of a run opening at bound, or the first after one closing at it
+    inline HalfOpenBound toHalfOpen(const Range& bound)
+    {
+        if (bound.second == 0)
+            return {false, bound.first};
+        return {bound.first == ~0ul, bound.first + 1};
+    }
+
+    // Runs of every multiplicity, held in one array grouped by multiplicity.
+    // The [start, stop] pairs of multiplicity m are
+    // bounds[offsets[m - 1]] up to bounds[offsets[m]], so (*this)[m - 1]
+    // is a view of them, much as with a vector of one vector per multiplicity.
+    class Multiplicities
+    {
+        public:
+
+            Multiplicities() : offsets(1, 0)
             {
-                multiplicity++;
-                //std::cout << "Open at: " << block << std::endl;
+            }
+
+            Multiplicities(std::vector<unsigned long> bounds, std::vector<std::size_t> offsets) :
+            bounds(std::move(bounds)), offsets(std::move(offsets))
+            {
+            }
+
+            // Number of multiplicities, at least the largest that occurs
+            std::size_t size() const
+            {
+                return offsets.size() - 1;
+            }
+
+            bool empty() const
+            {
+                return size() == 0;
+            }
+
+            // [start, stop] pairs of multiplicity i + 1
+            std::span<const unsigned long> operator[](std::size_t i) const
+            {
+                return std::span<const unsigned long>(bounds.data() + offsets[i], offsets[i+1] - offsets[i]);
+            }
+
+            std::span<const unsigned long> at(std::size_t i) const
+            {
+                if (i >= size())
+                    throw std::out_of_range("No such multiplicity.");
+                return (*this)[i];
+            }
+
+            // Pairs of all multiplicities, the lowest first
+            const std::vector<unsigned long>& getBounds() const
+            {
+                return bounds;
+            }
+
+            const std::vector<std::size_t>& getOffsets() const
+            {
+                return offsets;
+            }
+
+            // One vector of pairs per multiplicity, as toIntervals used to return
+            operator std::vector<std::vector<unsigned long>>() const
+            {
+                std::vector<std::vector<unsigned long>> nested(size());
+                for (std::size_t i = 0; i < size(); i++)
+                    nested[i].assign((*this)[i].begin(), (*this)[i].end());
+                return nested;
+            }
+
+        private:
+
+            std::vector<unsigned long> bounds;
+            std::vector<std::size_t> offsets;
+    };
 
-                // open -> closed OR open -> diff
-                if (interval_bounds[i+1].second == 1 || interval_bounds[i+1].first != block) // has volume!
+    // Sweep over sorted interval bounds, splitting the curve into runs of
+    // constant multiplicity. Bounds are pushed one at a time, so they can be
+    // streamed in from a merge without ever being stored together. A bound
+    // is handled once the next one is known, and closeLast() handles the last.
+    // Each run of nonzero multiplicity is handed to
+    // Derived::addRun(mult, start, stop) in curve order.
+    template <class Derived>
+    class RunSweep
+    {
+        public:
+
+            void push(const Range& bound)
+            {
+                if (has_previous)
+                    handle(previous, bound);
+
+                previous = bound;
+                has_previous = true;
+            }
+
+        protected:
+
+            // Close the last run
+            void closeLast()
+            {
+                if (has_previous)
                 {
-                    if (run)
+                    // obviously, we've reached the last boundary so there can't be any runs after this!
+                    unsigned long run_stop = previous.first;
+                    static_cast<Derived*>(this)->addRun(run_mult, run_start, run_stop);
+                    has_previous = false;
+                }
+            }
+
+        private:
+
+            void handle(const Range& bound, const Range& next)
+            {
+                unsigned long block = bound.first;
+                if (bound.second == 0) // open
+                {
+                    multiplicity++;
+
+                    // open -> closed OR open -> diff
+                    if (next.second == 1 || next.first != block) // has volume!
                     {
-                        if (multiplicity == run_mult)
+                        if (run)
                         {
-                            // keep running !
-                        }
-                        else
-                        {
-                            // the run stops here
-                            unsigned long run_stop = block - 1;
-                            // the current block STARTS a run of different multiplicity then the current run
-
-                            if (run_mult > 0)
+                            if (multiplicity != run_mult)
                             {
-                                multiplicities[run_mult - 1].emplace_back(run_start);
-                                multiplicities[run_mult - 1].emplace_back(run_stop);
-                            }
-                            //std::cout << "Ended run at: " << run_stop << " with multiplicity " << run_mult << std::endl;
-                            //std::cout << "Made run (" << run_start << ", " << run_stop << ") with multiplicity " << run_mult << std::endl;
+                                // the current block STARTS a run of different multiplicity then the current run
+                                if (run_mult > 0)
+                                    static_cast<Derived*>(this)->addRun(run_mult, run_start, block - 1);
 
-                            // start the next run !
+                                // start the next run !
+                                run_mult = multiplicity;
+                                run_start = block;
+                            }
+                        }
+                        else // start running !
+                        {
                             run = true;
                             run_mult = multiplicity;
                             run_start = block;
-                            //std::cout << "Starting run at: " << run_start << " with multiplicity " << run_mult << std::endl;
                         }
                     }
-                    else // start running !
-                    {
-                        run = true;
-                        run_mult = multiplicity;
-                        run_start = block;
-
-                        //std::cout << "Starting run at: " << run_start << " with multiplicity " << run_mult << std::endl;
-                    }
-                }
-                else // doesn't have volume!
-                {
                     // I think if there is no volume on an open block
                     // we can't be running yet
-                    // next loop iter
                 }
-            }
-            else // close
-            {
-                multiplicity--;
-                //std::cout << "Closed at: " << block << std::endl;
-
-                // closed -> diff closed OR closed -> nonconsec  open
-                if ( (interval_bounds[i+1].second == 1 && interval_bounds[i+1].first != block) || // has volume!
-                    (interval_bounds[i+1].first != (block+1) && interval_bounds[i+1].second == 0) )
+                else // close
                 {
-                    if (!run)
-                    {
-                        std::cout << "Volume! I thought this would never happen..." << std::endl;
-                    }
-                    else // we are in a run
+                    multiplicity--;
+
+                    // closed -> diff closed OR closed -> nonconsec  open
+                    if ((next.second == 1 && next.first != block) || // has volume!
+                        (next.first != (block+1) && next.second == 0))
                     {
-                        if (multiplicity == run_mult)
+                        if (!run)
                         {
-                        }// keep running!
-                        else
+                            std::cout << "Volume! I thought this would never happen..." << std::endl;
+                        }
+                        else if (multiplicity != run_mult)
                         {
-                            // the run stops here
-                            unsigned long run_stop = block;
                             // the current block ENDS a run
-                            
                             // Just ignore runs = 0
                             if (run_mult > 0)
-                            {
-                                //std::cout << "Ending run at: " << run_stop << " with multiplicity " << run_mult << std::endl;
-                                multiplicities[run_mult - 1].push_back(run_start);
-                                multiplicities[run_mult - 1].push_back(run_stop);
-                            }
-                            //std::cout << "Made run (" << run_start << ", " << run_stop << ") with multiplicity " << run_mult << std::endl;
+                                static_cast<Derived*>(this)->addRun(run_mult, run_start, block);
 
                             // start the next run !
                             // when starting run from a closed block
                             // we want to start from the next consecutive block (even if it isn't in the bounds list)
-                            run = true;
                             run_mult = multiplicity;
                             run_start = block + 1;
-
-                            //std::cout << "Starting run at: " << run_start << " with multiplicity " << run_mult << std::endl;
                         }
                     }
-                }
-                else // doesn't have volume!
-                {
-                    if (run)
-                    {
-                        // std::cout << "running" << std::endl;
-                    }
-                    else
+                    else if (!run)
                     {
                         std::cout << "No volume! I thought this would never happen..." << std::endl;
                     }
                 }
             }
-        }
-        // obviously, we've reached the last boundary so there can't be any runs after this!
-        unsigned long run_stop = interval_bounds[i].first;
-        multiplicities[run_mult - 1].emplace_back(run_start);
-        multiplicities[run_mult - 1].emplace_back(run_stop);
-        //std::cout << "Made run (" << run_start << ", " << run_stop << ") with multiplicity " << run_mult << std::endl;
 
-        return multiplicities;
-    }
+            Range previous;
+            bool has_previous = false;
 
-    inline std::vector<std::vector<unsigned long>> toIntervals(const std::vector<Blockset>& forest)
+            bool run = false;
+            int run_mult = 0;
+            unsigned long run_start = 0;
+            int multiplicity = 0;
+    };
+
+    // Sweep collecting the runs of every multiplicity. Runs are kept in curve
+    // order with their multiplicity and only grouped by multiplicity at the
+    // end, once the largest one is known.
+    class MultiplicitySweep : public RunSweep<MultiplicitySweep>
     {
-        Rangeset combined_rangeset; // should prealocate
+        public:
 
+            // There are at least min_multiplicities entries in the result
+            MultiplicitySweep(std::size_t min_multiplicities = 0) :
+            counts(min_multiplicities)
+            {
+            }
+
+            // Close the last run and return the runs of each multiplicity
+            Multiplicities finish()
+            {
+                closeLast();
+
+                // Counting sort of the runs by multiplicity, which keeps
+                // the runs of each multiplicity in curve order
+                std::vector<std::size_t> offsets(counts.size() + 1, 0);
+                for (std::size_t i = 0; i < counts.size(); i++)
+                    offsets[i+1] = offsets[i] + 2*counts[i];
+
+                std::vector<std::size_t> next(offsets.begin(), offsets.end() - 1);
+                std::vector<unsigned long> bounds(offsets.back());
+                for (const Run& run : runs)
+                {
+                    std::size_t& k = next[run.mult - 1];
+                    bounds[k++] = run.start;
+                    bounds[k++] = run.stop;
+                }
+
+                runs.clear();
+                counts.clear();
+                return Multiplicities(std::move(bounds), std::move(offsets));
+            }
+
+        private:
+
+            friend class RunSweep<MultiplicitySweep>;
+
+            struct Run
+            {
+                unsigned long start;
+                unsigned long stop;
+                int mult;
+            };
+
+            void addRun(int mult, unsigned long start, unsigned long stop)
+            {
+                if (mult > counts.size())
+                    counts.resize(mult, 0);
+                counts[mult - 1]++;
+                runs.push_back({start, stop, mult});
+            }
+
+            std::vector<Run> runs;
+            std::vector<std::size_t> counts; // runs of each multiplicity
+    };
+
+    // Multiplicities of sorted interval bounds, up to the largest that occurs
+    inline Multiplicities toIntervals(const Rangeset& interval_bounds)
+    {
+        MultiplicitySweep sweep;
+        for (int i = 0; i < interval_bounds.size(); i++)
+            sweep.push(interval_bounds[i]);
+
+        return sweep.finish();
+    }
+
+    // Hand the interval bounds of a forest of blocksets to push(bound, tree)
+    // in order, with the index of the tree each comes from.
+    // The interval bounds of the trees are merged straight into the sweep,
+    // with no combined list to sort. Each tree is split into its runs of
+    // blocks in Z-order, such as the levels of a breadth-first refine or the
+    // whole of a depth-first one. The next opening bound comes from a heap
+    // holding the next block of every run, and the closing bounds wait in a
+    // second heap until they are reached. This is O(N log r) for N blocks
+    // in r runs, and only the heaps are held in memory besides the forest.
+    template <class Push>
+    inline void mergeForest(const std::vector<Blockset>& forest, Push&& push)
+    {
         int largest_level = 0;
         for (int i = 0; i < forest.size(); i++)
         {
             if (forest[i].size() != 0)
             {
-                int level = getLevel(forest[i].back());
+                int level = getMaxLevel(forest[i]);
                 if (level > largest_level)
                     largest_level = level;
             }
         }
 
-        // Add each octree in forest to the combined rangeset
-        for (int i = 0; i < forest.size(); i++)
+        auto getStart = [&](unsigned long block){ return getSmallestChild(block, largest_level - getLevel(block)); };
+        auto getStop = [&](unsigned long block){ return getLargestChild(block, largest_level - getLevel(block)); };
+
+        // Next opening bound of every run, the smallest on top
+        struct Run
         {
-            if (forest[i].size() != 0)
+            unsigned long start;
+            const unsigned long* next;
+            const unsigned long* end;
+            std::size_t tree;
+
+            bool operator>(const Run& other) const
             {
-                Rangeset rangeset = toIntervalBounds(forest[i],largest_level);
-                // Append to the combined rangeset
-                combined_rangeset.insert(combined_rangeset.end(),rangeset.begin(),rangeset.end());
+                return start > other.start;
+            }
+        };
+
+        std::vector<Run> openings;
+        for (std::size_t i = 0; i < forest.size(); i++)
+        {
+            const Blockset& tree = forest[i];
+            std::size_t begin = 0;
+            for (std::size_t j = 1; j <= tree.size(); j++)
+            {
+                if (j == tree.size() || curvePosition(tree[j]) < curvePosition(tree[j-1]))
+                {
+                    openings.push_back({getStart(tree[begin]), tree.data() + begin, tree.data() + j, i});
+                    begin = j;
+                }
             }
         }
-        std::sort(combined_rangeset.begin(),combined_rangeset.end());
+        std::make_heap(openings.begin(), openings.end(), std::greater<Run>());
 
-        std::vector<std::vector<unsigned long>> multiplicities = toIntervals(combined_rangeset);
+        // Closing bounds of the open blocks and their trees, the smallest on top
+        using Closing = std::pair<unsigned long, std::size_t>;
+        std::vector<Closing> closings;
 
-        return multiplicities;
+        while (!openings.empty() || !closings.empty())
+        {
+            // At the same position a block opens before another closes
+            if (!openings.empty() && (closings.empty() || openings.front().start <= closings.front().first))
+            {
+                std::pop_heap(openings.begin(), openings.end(), std::greater<Run>());
+                Run& run = openings.back();
+
+                push(Range({run.start, 0}), run.tree);
+                closings.push_back({getStop(*run.next), run.tree});
+                std::push_heap(closings.begin(), closings.end(), std::greater<Closing>());
+
+                if (++run.next != run.end)
+                {
+                    run.start = getStart(*run.next);
+                    std::push_heap(openings.begin(), openings.end(), std::greater<Run>());
+                }
+                else
+                    openings.pop_back();
+            }
+            else
+            {
+                std::pop_heap(closings.begin(), closings.end(), std::greater<Closing>());
+                push(Range({closings.back().first, 1}), closings.back().second);
+                closings.pop_back();
+            }
+        }
+    }
+
+    // Multiplicities of a forest of blocksets.
+    // There is an entry for every multiplicity up to at least the number of trees.
+    inline Multiplicities toIntervals(const std::vector<Blockset>& forest)
+    {
+        MultiplicitySweep sweep(forest.size());
+        mergeForest(forest, [&](const Range& bound, std::size_t){ sweep.push(bound); });
+        return sweep.finish();
+    }
+
+    // Sweep keeping only the runs whose multiplicity passes keep(mult), joined
+    // where they touch, and handing each joined interval to visit(start, stop)
+    // as soon as it is complete. Nothing but the current interval is stored.
+    template <class Keep, class Visit>
+    class ThresholdSweep : public RunSweep<ThresholdSweep<Keep, Visit>>
+    {
+        public:
+
+            ThresholdSweep(Keep keep, Visit visit) : keep(std::move(keep)), visit(std::move(visit))
+            {
+            }
+
+            void finish()
+            {
+                this->closeLast();
+                if (open)
+                    visit(start, stop);
+                open = false;
+            }
+
+        private:
+
+            friend class RunSweep<ThresholdSweep<Keep, Visit>>;
+
+            void addRun(int mult, unsigned long run_start, unsigned long run_stop)
+            {
+                if (!keep(mult))
+                    return;
+
+                if (open && run_start == stop + 1)
+                {
+                    stop = run_stop;
+                    return;
+                }
+
+                if (open)
+                    visit(start, stop);
+                start = run_start;
+                stop = run_stop;
+                open = true;
+            }
+
+            Keep keep;
+            Visit visit;
+
+            bool open = false;
+            unsigned long start = 0;
+            unsigned long stop = 0;
+    };
+
+    // Hand visit(start, stop) the intervals of the finest level of forest
+    // covered by a number of trees that passes keep, in curve order, in one
+    // pass over the forest
+    template <class Keep, class Visit>
+    inline void sweepThreshold(const std::vector<Blockset>& forest, Keep&& keep, Visit&& visit)
+    {
+        ThresholdSweep<std::decay_t<Keep>, std::decay_t<Visit>> sweep(std::forward<Keep>(keep), std::forward<Visit>(visit));
+        mergeForest(forest, [&](const Range& bound, std::size_t){ sweep.push(bound); });
+        sweep.finish();
+    }
+
+    template <class Keep>
+    inline Intervalset thresholdIntervals(const std::vector<Blockset>& forest, Keep&& keep)
+    {
+        Intervalset intervals;
+        sweepThreshold(forest, std::forward<Keep>(keep),
+            [&](unsigned long start, unsigned long stop){ intervals.push_back({start, stop}); });
+        return intervals;
+    }
+
+    // Intervals covered by at least k trees of forest
+    inline Intervalset atLeastKIntervals(const std::vector<Blockset>& forest, int k)
+    {
+        return thresholdIntervals(forest, [k](int mult){ return mult >= k; });
+    }
+
+    // Intervals covered by exactly k trees of forest, for k of 1 or more
+    inline Intervalset exactlyKIntervals(const std::vector<Blockset>& forest, int k)
+    {
+        return thresholdIntervals(forest, [k](int mult){ return mult == k; });
+    }
+
+    // Intervals covered by at least one and at most k trees of forest
+    inline Intervalset atMostKIntervals(const std::vector<Blockset>& forest, int k)
+    {
+        return thresholdIntervals(forest, [k](int mult){ return mult <= k; });
+    }
+
+    // Set of sensors, by the index of their tree in a forest. Sets of forests
+    // of up to 64 trees are a bitmask, and larger ones a sorted list of ids.
+    class SensorSet
+    {
+        public:
+
+            static const std::size_t MAX_MASK_SENSORS = 64;
+
+            explicit SensorSet(std::size_t num_sensors = 0) : wide(num_sensors > MAX_MASK_SENSORS)
+            {
+            }
+
+            void insert(std::size_t id)
+            {
+                if (!wide)
+                {
+                    mask |= std::uint64_t(1) << id;
+                    return;
+                }
+                auto it = std::lower_bound(ids.begin(), ids.end(), id);
+                if (it == ids.end() || *it != id)
+                    ids.insert(it, id);
+            }
+
+            void erase(std::size_t id)
+            {
+                if (!wide)
+                {
+                    mask &= ~(std::uint64_t(1) << id);
+                    return;
+                }
+                auto it = std::lower_bound(ids.begin(), ids.end(), id);
+                if (it != ids.end() && *it == id)
+                    ids.erase(it);
+            }
+
+            bool contains(std::size_t id) const
+            {
+                if (!wide)
+                    return (mask >> id) & 1;
+                return std::binary_search(ids.begin(), ids.end(), id);
+            }
+
+            std::size_t size() const
+            {
+                return wide ? ids.size() : __builtin_popcountl(mask);
+            }
+
+            bool empty() const
+            {
+                return wide ? ids.empty() : mask == 0;
+            }
+
+            // Ids in the set in increasing order
+            std::vector<std::size_t> getIds() const
+            {
+                if (wide)
+                    return ids;
+
+                std::vector<std::size_t> set_ids;
+                for (std::uint64_t bits = mask; bits != 0; bits &= bits - 1)
+                    set_ids.push_back(__builtin_ctzl(bits));
+                return set_ids;
+            }
+
+            auto operator<=>(const SensorSet& other) const = default;
+
+        private:
+
+            bool wide;
+            std::uint64_t mask = 0;
+            std::vector<std::size_t> ids;
+    };
+
+    // Hand visit(start, stop, sensors) the intervals of the finest level of
+    // forest in curve order, each with the set of trees covering all of it.
+    // Touching intervals with the same set are joined, and uncovered space is
+    // skipped. A tree may hold nested blocks, so the blocks open in each tree
+    // are counted and a tree leaves the set when its count returns to zero.
+    template <class Visit>
+    inline void sweepSensors(const std::vector<Blockset>& forest, Visit&& visit)
+    {
+        SensorSet current(forest.size());
+        std::vector<int> open(forest.size(), 0);
+
+        // The set of the interval before position, still to be visited
+        bool pending = false;
+        unsigned long pending_start = 0;
+        unsigned long pending_stop = 0;
+        SensorSet pending_set(forest.size());
+        HalfOpenBound position;
+
+        mergeForest(forest, [&](const Range& bound, std::size_t tree)
+        {
+            // Half-open bounds, where a block closing at stop ends before stop + 1
+            HalfOpenBound next = toHalfOpen(bound);
+            if (next != position && !current.empty())
+            {
+                if (pending && pending_stop + 1 == position.position && pending_set == current)
+                    pending_stop = next.last();
+                else
+                {
+                    if (pending)
+                        visit(pending_start, pending_stop, static_cast<const SensorSet&>(pending_set));
+                    pending = true;
+                    pending_start = position.position;
+                    pending_stop = next.last();
+                    pending_set = current;
+                }
+            }
+            position = next;
+
+            if (bound.second == 0)
+            {
+                if (open[tree]++ == 0)
+                    current.insert(tree);
+            }
+            else if (--open[tree] == 0)
+                current.erase(tree);
+        });
+
+        if (pending)
+            visit(pending_start, pending_stop, static_cast<const SensorSet&>(pending_set));
+    }
+
+    // Intervals of the finest level of forest grouped by the set of trees
+    // covering them, each group in curve order
+    inline std::map<SensorSet, Intervalset> toSensorIntervals(const std::vector<Blockset>& forest)
+    {
+        std::map<SensorSet, Intervalset> groups;
+        sweepSensors(forest, [&](unsigned long start, unsigned long stop, const SensorSet& sensors)
+        {
+            groups[sensors].push_back({start, stop});
+        });
+        return groups;
+    }
+
+    // Hand visit(start, stop, total) the intervals of the finest level of
+    // forest in curve order, each with the summed weights[i] of the trees i
+    // covering it. Touching intervals with the same total are joined, and
+    // uncovered space is skipped. Totals are kept as a running sum, so with
+    // floating point weights equal totals reached in different orders may
+    // differ by rounding, and binning is the safer way to group them.
+    template <class Weight, class Visit>
+    inline void sweepWeights(const std::vector<Blockset>& forest, const std::vector<Weight>& weights, Visit&& visit)
+    {
+        if (weights.size() != forest.size())
+            throw std::invalid_argument("There must be one weight per tree of the forest.");
+
+        int multiplicity = 0;
+        Weight total = 0;
+        HalfOpenBound position;
+
+        bool pending = false;
+        unsigned long pending_start = 0;
+        unsigned long pending_stop = 0;
+        Weight pending_total = 0;
+
+        mergeForest(forest, [&](const Range& bound, std::size_t tree)
+        {
+            // Half-open bounds, where a block closing at stop ends before stop + 1
+            HalfOpenBound next = toHalfOpen(bound);
+            if (next != position && multiplicity > 0)
+            {
+                if (pending && pending_stop + 1 == position.position && pending_total == total)
+                    pending_stop = next.last();
+                else
+                {
+                    if (pending)
+                        visit(pending_start, pending_stop, pending_total);
+                    pending = true;
+                    pending_start = position.position;
+                    pending_stop = next.last();
+                    pending_total = total;
+                }
+            }
+            position = next;
+
+            if (bound.second == 0)
+            {
+                multiplicity++;
+                total += weights[tree];
+            }
+            else if (--multiplicity == 0)
+                total = 0; // no rounding carried across gaps
+            else
+                total -= weights[tree];
+        });
+
+        if (pending)
+            visit(pending_start, pending_stop, pending_total);
+    }
+
+    // Intervals of the finest level of forest grouped by the summed weight
+    // of the trees covering them, each group in curve order
+    template <class Weight>
+    inline std::map<Weight, Intervalset> toWeightedIntervals(const std::vector<Blockset>& forest, const std::vector<Weight>& weights)
+    {
+        std::map<Weight, Intervalset> groups;
+        sweepWeights(forest, weights, [&](unsigned long start, unsigned long stop, Weight total)
+        {
+            groups[total].push_back({start, stop});
+        });
+        return groups;
+    }
+
+    // Bin of a total among sorted edges, bin i holding totals from edges[i]
+    // up to edges[i+1] and the last bin everything from edges.back(),
+    // or -1 below edges[0]
+    template <class Weight>
+    inline int getBin(const std::vector<Weight>& edges, Weight total)
+    {
+        return static_cast<int>(std::upper_bound(edges.begin(), edges.end(), total) - edges.begin()) - 1;
+    }
+
+    // Intervals of the finest level of forest in each bin of summed weight,
+    // bins[i] in curve order with touching intervals joined
+    template <class Weight>
+    inline std::vector<Intervalset> toWeightBins(const std::vector<Blockset>& forest, const std::vector<Weight>& weights,
+        const std::vector<Weight>& edges)
+    {
+        std::vector<Intervalset> bins(edges.size());
+        sweepWeights(forest, weights, [&](unsigned long start, unsigned long stop, Weight total)
+        {
+            int bin = getBin(edges, total);
+            if (bin < 0)
+                return;
+
+            Intervalset& intervals = bins[bin];
+            if (!intervals.empty() && intervals.back()[1] + 1 == start)
+                intervals.back()[1] = stop;
+            else
+                intervals.push_back({start, stop});
+        });
+        return bins;
+    }
+
+    // Hand visit(tree, start, stop) the intervals of the finest level of
+    // forest covered by tree alone. Only the number of open blocks and the sum
+    // of their tree ids are tracked, which is the id of the one tree wherever
+    // the number is one, so no sets are built. The blocks of each tree must
+    // be disjoint, as from a refine.
+    template <class Visit>
+    inline void sweepUnique(const std::vector<Blockset>& forest, Visit&& visit)
+    {
+        int multiplicity = 0;
+        std::size_t id_sum = 0;
+        HalfOpenBound position;
+
+        mergeForest(forest, [&](const Range& bound, std::size_t tree)
+        {
+            HalfOpenBound next = toHalfOpen(bound);
+            if (next != position && multiplicity == 1)
+                visit(id_sum, position.position, next.last());
+            position = next;
+
+            if (bound.second == 0)
+            {
+                multiplicity++;
+                id_sum += tree;
+            }
+            else
+            {
+                multiplicity--;
+                id_sum -= tree;
+            }
+        });
     }
 
     // start and stop must be on same level of morton curve!
@@ -405,6 +1027,8 @@ namespace libzealand
 	    unsigned long block = start >> (shift*3); // parent
 
             cells.push_back(block);
+            if (z_stop == stop)
+                break; // stop may be the last level-20 block, with nothing after it
             start = ++z_stop;
         }
     }
@@ -451,7 +1075,7 @@ namespace libzealand
             cells.push_back(start);
     }
 
-    inline Blockset recombine(const std::vector<unsigned long>& intervals)
+    inline Blockset recombine(std::span<const unsigned long> intervals)
     {
         Blockset cells;
 
@@ -463,17 +1087,299 @@ namespace libzealand
 
         for (int i = 0; i < intervals.size() - 1; i += 2)
         {
-            unsigned long start = intervals.at(i);
-            unsigned long stop = intervals.at(i+1);
+            unsigned long start = intervals[i];
+            unsigned long stop = intervals[i+1];
 
             interval_to_cells(start,stop,cells);
         }
         return cells;
     }
 
+    inline Blockset recombine(const Intervalset& intervals)
+    {
+        Blockset cells;
+        cells.reserve(intervals.size()*2);
+
+        for (const Interval& interval : intervals)
+            interval_to_cells(interval[0], interval[1], cells);
+        return cells;
+    }
+
+    // Blocks covered by at least k trees of forest, the union of
+    // multiplicities k and up of octreeMultiplicities
+    inline Blockset atLeastK(const std::vector<Blockset>& forest, int k)
+    {
+        return recombine(atLeastKIntervals(forest, k));
+    }
+
+    inline Blockset exactlyK(const std::vector<Blockset>& forest, int k)
+    {
+        return recombine(exactlyKIntervals(forest, k));
+    }
+
+    inline Blockset atMostK(const std::vector<Blockset>& forest, int k)
+    {
+        return recombine(atMostKIntervals(forest, k));
+    }
+
+    // Sort blocks of mixed levels in Z-order, coarser first among blocks
+    // at the same position, with a linear-time LSD radix sort
+    inline void sortByCurvePosition(Blockset& blockset)
+    {
+        std::size_t n = blockset.size();
+        if (n < 2)
+            return;
+
+        // First by level, so that the sort by position keeps the coarser
+        // blocks ahead
+        Blockset sorted(n);
+        std::array<std::size_t, MAX_LEVEL + 3> level_offsets{};
+        for (unsigned long block : blockset)
+            level_offsets[getLevel(block) + 2]++;
+        for (std::size_t i = 1; i < level_offsets.size(); i++)
+            level_offsets[i] += level_offsets[i-1];
+        for (unsigned long block : blockset)
+            sorted[level_offsets[getLevel(block) + 1]++] = block;
+        blockset.swap(sorted);
+
+        // then by position, skipping the digits every block shares, such as the
+        // low digits below the finest level. The counts of all digits are
+        // taken in one pass.
+        const int DIGIT_BITS = 11;
+        const int NUM_PASSES = (64 + DIGIT_BITS - 1)/DIGIT_BITS;
+        const unsigned long DIGIT_MASK = (1ul << DIGIT_BITS) - 1;
+        std::vector<std::size_t> offsets(NUM_PASSES << DIGIT_BITS, 0);
+        for (unsigned long block : blockset)
+        {
+            unsigned long position = curvePosition(block);
+            for (int pass = 0; pass < NUM_PASSES; pass++)
+                offsets[(pass << DIGIT_BITS) + ((position >> (pass*DIGIT_BITS)) & DIGIT_MASK)]++;
+        }
+
+        for (int pass = 0; pass < NUM_PASSES; pass++)
+        {
+            int shift = pass*DIGIT_BITS;
+            std::size_t* pass_offsets = offsets.data() + (pass << DIGIT_BITS);
+            if (pass_offsets[(curvePosition(blockset[0]) >> shift) & DIGIT_MASK] == n)
+                continue;
+
+            std::size_t total = 0;
+            for (std::size_t digit = 0; digit <= DIGIT_MASK; digit++)
+            {
+                std::size_t count = pass_offsets[digit];
+                pass_offsets[digit] = total;
+                total += count;
+            }
+            for (unsigned long block : blockset)
+                sorted[pass_offsets[(curvePosition(block) >> shift) & DIGIT_MASK]++] = block;
+            blockset.swap(sorted);
+        }
+    }
+
+    // Put blockset in canonical form: sorted by curvePosition, with duplicates
+    // and blocks inside other blocks removed, and every complete set of 8
+    // siblings replaced by their parent, so that equal regions give equal
+    // blocksets. Blocks may come in any order and at mixed levels.
+    // Linear in the number of blocks.
+    inline void normalize(Blockset& blockset)
+    {
+        // At the same position the coarser block is the smaller number
+        auto before = [](unsigned long a, unsigned long b)
+        {
+            unsigned long position_a = curvePosition(a);
+            unsigned long position_b = curvePosition(b);
+            return position_a < position_b || (position_a == position_b && a < b);
+        };
+        if (!std::is_sorted(blockset.begin(), blockset.end(), before))
+            sortByCurvePosition(blockset);
+
+        // Keep blocks starting past the end of the last one kept, using the
+        // front of blockset as a stack on which complete siblings are merged
+        std::size_t size = 0;
+        unsigned long covered_end = 0;
+        for (std::size_t i = 0; i < blockset.size(); i++)
+        {
+            unsigned long block = blockset[i];
+            unsigned long start = curvePosition(block);
+            if (size > 0 && start <= covered_end)
+                continue;
+
+            covered_end = start | set3NBits(MAX_LEVEL - getLevel(block));
+            blockset[size++] = block;
+
+            // The last child of a parent may complete it, and the parent its own parent
+            while ((block & 7) == 7 && size >= 8)
+            {
+                unsigned long first = block ^ 7;
+                bool complete = true;
+                for (unsigned long j = 0; j < 8 && complete; j++)
+                    complete = blockset[size - 8 + j] == (first | j);
+                if (!complete)
+                    break;
+
+                size -= 7;
+                block = block >> 3;
+                blockset[size - 1] = block;
+            }
+        }
+        blockset.resize(size);
+    }
+
+    // Sorted, disjoint intervals of level blocks covered by the blocks of blockset,
+    // with touching intervals joined. No block may be finer than level.
+    inline Intervalset toIntervalset(const Blockset& blockset, int level)
+    {
+        Intervalset intervals;
+        intervals.reserve(blockset.size());
+        for (unsigned long block : blockset)
+        {
+            int depth = level - getLevel(block);
+            intervals.push_back({getSmallestChild(block, depth), getLargestChild(block, depth)});
+        }
+
+        // Blocks from a refine come in a few runs already in Z-order,
+        // one per level, so merge the runs rather than sorting
+        std::vector<std::size_t> runs({0});
+        for (std::size_t i = 1; i < intervals.size(); i++)
+        {
+            if (intervals[i][0] < intervals[i-1][0])
+                runs.push_back(i);
+        }
+        runs.push_back(intervals.size());
+
+        while (runs.size() > 2)
+        {
+            std::vector<std::size_t> merged({0});
+            for (std::size_t k = 0; k + 1 < runs.size(); k += 2)
+            {
+                if (k + 2 < runs.size())
+                {
+                    std::inplace_merge(intervals.begin() + runs[k], intervals.begin() + runs[k+1],
+                        intervals.begin() + runs[k+2]);
+                    merged.push_back(runs[k+2]);
+                }
+                else
+                    merged.push_back(runs[k+1]);
+            }
+            runs = std::move(merged);
+        }
+
+        std::size_t n = 0;
+        for (std::size_t i = 0; i < intervals.size(); i++)
+        {
+            if (n > 0 && (intervals[n-1][1] == ~0ul || intervals[i][0] <= intervals[n-1][1] + 1))
+                intervals[n-1][1] = std::max(intervals[n-1][1], intervals[i][1]);
+            else
+                intervals[n++] = intervals[i];
+        }
+        intervals.resize(n);
+        return intervals;
+    }
+
+    // Merge two sorted, disjoint intervalsets on the same level, keeping the
+    // blocks for which keep(in_a, in_b) holds. Linear in the number of intervals.
+    template <class Keep>
+    inline Intervalset combine(const Intervalset& a, const Intervalset& b, Keep&& keep)
+    {
+        // Bounds as half-open [start, stop + 1), with none left in an exhausted set
+        auto nextBound = [](const Intervalset& set, std::size_t i, bool inside)
+        {
+            if (i == set.size())
+                return std::optional<HalfOpenBound>();
+            return std::optional<HalfOpenBound>(inside ? toHalfOpen({set[i][1], 1}) : toHalfOpen({set[i][0], 0}));
+        };
+
+        Intervalset result;
+        std::size_t i = 0, j = 0;
+        bool in_a = false, in_b = false;
+        unsigned long start = 0;
+        while (true)
+        {
+            std::optional<HalfOpenBound> bound_a = nextBound(a, i, in_a);
+            std::optional<HalfOpenBound> bound_b = nextBound(b, j, in_b);
+            if (!bound_a && !bound_b)
+                break;
+            HalfOpenBound bound = !bound_b || (bound_a && *bound_a < *bound_b) ? *bound_a : *bound_b;
+
+            bool kept = keep(in_a, in_b);
+            if (bound_a == bound)
+            {
+                i += in_a;
+                in_a = !in_a;
+            }
+            if (bound_b == bound)
+            {
+                j += in_b;
+                in_b = !in_b;
+            }
+
+            if (!kept && keep(in_a, in_b))
+            {
+                start = bound.position;
+            }
+            else if (kept && !keep(in_a, in_b))
+            {
+                // Join runs that touch, where a set has touching intervals
+                if (!result.empty() && result.back()[1] + 1 == start)
+                    result.back()[1] = bound.last();
+                else
+                    result.push_back({start, bound.last()});
+            }
+        }
+        return result;
+    }
+
+    inline Intervalset unite(const Intervalset& a, const Intervalset& b)
+    {
+        return combine(a, b, [](bool in_a, bool in_b){ return in_a || in_b; });
+    }
+
+    inline Intervalset intersect(const Intervalset& a, const Intervalset& b)
+    {
+        return combine(a, b, [](bool in_a, bool in_b){ return in_a && in_b; });
+    }
+
+    inline Intervalset subtract(const Intervalset& a, const Intervalset& b)
+    {
+        return combine(a, b, [](bool in_a, bool in_b){ return in_a && !in_b; });
+    }
+
+    inline Intervalset symmetricDifference(const Intervalset& a, const Intervalset& b)
+    {
+        return combine(a, b, [](bool in_a, bool in_b){ return in_a != in_b; });
+    }
+
+    // The same operations on blocksets of any levels, returning the fewest blocks
+    template <class Keep>
+    inline Blockset combine(const Blockset& a, const Blockset& b, Keep&& keep)
+    {
+        int level = std::max(getMaxLevel(a), getMaxLevel(b));
+        return recombine(combine(toIntervalset(a, level), toIntervalset(b, level), keep));
+    }
+
+    inline Blockset unite(const Blockset& a, const Blockset& b)
+    {
+        return combine(a, b, [](bool in_a, bool in_b){ return in_a || in_b; });
+    }
+
+    inline Blockset intersect(const Blockset& a, const Blockset& b)
+    {
+        return combine(a, b, [](bool in_a, bool in_b){ return in_a && in_b; });
+    }
+
+    inline Blockset subtract(const Blockset& a, const Blockset& b)
+    {
+        return combine(a, b, [](bool in_a, bool in_b){ return in_a && !in_b; });
+    }
+
+    inline Blockset symmetricDifference(const Blockset& a, const Blockset& b)
+    {
+        return combine(a, b, [](bool in_a, bool in_b){ return in_a != in_b; });
+    }
+
     inline std::vector<Blockset> octreeMultiplicities(const std::vector<Blockset>& forest)
     {
-        std::vector<std::vector<unsigned long>> interval_mults = toIntervals(forest);
+        Multiplicities interval_mults = toIntervals(forest);
 
         // Number of octree multiplicities should
         // of course be the same as the number
@@ -517,6 +1423,67 @@ namespace libzealand
         return coverage;
     }
 
+    inline AlignedBox3 getBoundingBox(const Sphere3& sphere)
+    {
+        const Vector3& c = sphere.center;
+        Real r = sphere.radius;
+        return AlignedBox3(Vector3({c[0] - r, c[1] - r, c[2] - r}), Vector3({c[0] + r, c[1] + r, c[2] + r}));
+    }
+
+    // Classify a box against a sphere in one pass.
+    // The squared distances from the center to the nearest
+    // and farthest points of the box are accumulated together.
+    inline Containment classify(const AlignedBox3& box, const Sphere3& sphere)
+    {
+        Real near_sqr = 0;
+        Real far_sqr = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            Real lo = box.min[i] - sphere.center[i];
+            Real hi = box.max[i] - sphere.center[i];
+
+            if (lo > 0)
+                near_sqr += lo*lo;
+            else if (hi < 0)
+                near_sqr += hi*hi;
+
+            far_sqr += std::max(lo*lo, hi*hi);
+        }
+
+        Real radius_sqr = sphere.radius*sphere.radius;
+        if (near_sqr > radius_sqr)
+            return OUTSIDE;
+        else if (far_sqr <= radius_sqr)
+            return INSIDE;
+        return PARTIAL;
+    }
+
+    // Classify a box against a convex shape.
+    // The vertices are tested first: all inside means the box is inside,
+    // and a mix means it crosses the boundary. Only when every vertex is
+    // outside is the (more expensive) intersection query needed.
+    template <class Shape, class Query>
+    inline Containment classifyByVertices(const AlignedBox3& box, const Shape& shape, Query& query)
+    {
+        std::array<Vector3,8> vertices;
+        box.GetVertices(vertices);
+
+        int num_inside = 0;
+        for (int i = 0; i < vertices.size(); i++)
+        {
+            if (gte::InContainer(vertices[i], shape))
+                num_inside++;
+            else if (num_inside > 0)
+                return PARTIAL;
+        }
+
+        if (num_inside == vertices.size())
+            return INSIDE;
+        else if (num_inside > 0 || query(box, shape).intersect)
+            return PARTIAL;
+        return OUTSIDE;
+    }
+
     inline unsigned long encode(unsigned int x, unsigned int y, unsigned int z)
     {
         unsigned long block = libmorton::morton3D_64_encode(x,y,z);